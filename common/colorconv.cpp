@@ -0,0 +1,264 @@
+// colorconv.cpp
+// RGB <-> HSV conversion shared by the projects, one pixel at a time or over whole arrays.
+
+#include "colorconv.h"
+
+#include <cmath>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+//float value of each 0 - 255 channel on scale 0 - 1, so every path converts channels identically
+struct UnitTable {
+  float value[256];
+  UnitTable() {
+    for (int i = 0; i < 256; i++)
+      value[i] = i / 255.0;
+  }
+};
+
+static const float* unitTable() {
+  static UnitTable table;
+  return table.value;
+}
+
+/*
+  Branch free RGB to HSV. Every candidate hue is computed and the right one selected, so the
+  compiler can use selects instead of jumps and the same steps map directly onto SIMD lanes.
+  When the color is grey delta is 0 and the hue and saturation come out 0, as in the sector version.
+*/
+static inline void hsvFromRgb(float r, float g, float b, float &h, float &s, float &v) {
+  float maxc = r > g ? r : g;
+  maxc = maxc > b ? maxc : b;
+  float minc = r < g ? r : g;
+  minc = minc < b ? minc : b;
+  float delta = maxc - minc;
+
+  v = maxc;
+  s = delta / (maxc > 0 ? maxc : 1.0f);
+
+  float inv = 1.0f / (delta > 0 ? delta : 1.0f);
+  float hr = (g - b) * inv;
+  float hg = 2.0f + (b - r) * inv;
+  float hb = 4.0f + (r - g) * inv;
+  float hue = r == maxc ? hr : (g == maxc ? hg : hb);
+  hue = delta > 0 ? hue * 60.0f : 0.0f;
+  h = hue < 0 ? hue + 360.0f : hue;
+}
+
+//one channel of HSV to RGB: n is 5 for red, 3 for green and 1 for blue, h6 is the hue on scale 0 - 6
+static inline float rgbChannel(float n, float h6, float s, float v) {
+  float k = n + h6;
+  k = k >= 6.0f ? k - 6.0f : k;
+  float t = k < 4.0f - k ? k : 4.0f - k;
+  t = t < 1.0f ? t : 1.0f;
+  t = t > 0.0f ? t : 0.0f;
+  return v - v * s * t;
+}
+
+//hue in degrees to scale 0 - 6, wrapping values outside 0 - 360
+static inline float hueSextant(float h) {
+  float h6 = h / 60.0f;
+  return h6 - 6.0f * floorf(h6 / 6.0f);
+}
+
+void rgbToHsv(unsigned char r, unsigned char g, unsigned char b, float &h, float &s, float &v) {
+  const float* unit = unitTable();
+  hsvFromRgb(unit[r], unit[g], unit[b], h, s, v);
+}
+
+void hsvToRgb(float h, float s, float v, unsigned char &r, unsigned char &g, unsigned char &b) {
+  float h6 = hueSextant(h);
+  r = (unsigned char)(rgbChannel(5.0f, h6, s, v) * 255.0f + 0.5f);
+  g = (unsigned char)(rgbChannel(3.0f, h6, s, v) * 255.0f + 0.5f);
+  b = (unsigned char)(rgbChannel(1.0f, h6, s, v) * 255.0f + 0.5f);
+}
+
+#ifdef __SSE2__
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b) {
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+#endif
+
+void rgbToHsvPlanar(const float* r, const float* g, const float* b, int n, float* h, float* s, float* v) {
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 two = _mm_set1_ps(2.0f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 sixty = _mm_set1_ps(60.0f);
+  const __m128 full = _mm_set1_ps(360.0f);
+
+  for (; i + 4 <= n; i += 4) {
+    __m128 R = _mm_loadu_ps(r + i);
+    __m128 G = _mm_loadu_ps(g + i);
+    __m128 B = _mm_loadu_ps(b + i);
+
+    __m128 maxc = _mm_max_ps(_mm_max_ps(R, G), B);
+    __m128 minc = _mm_min_ps(_mm_min_ps(R, G), B);
+    __m128 delta = _mm_sub_ps(maxc, minc);
+    __m128 colored = _mm_cmpgt_ps(delta, zero);
+
+    __m128 S = _mm_div_ps(delta, select4(_mm_cmpgt_ps(maxc, zero), maxc, one));
+
+    __m128 inv = _mm_div_ps(one, select4(colored, delta, one));
+    __m128 hr = _mm_mul_ps(_mm_sub_ps(G, B), inv);
+    __m128 hg = _mm_add_ps(two, _mm_mul_ps(_mm_sub_ps(B, R), inv));
+    __m128 hb = _mm_add_ps(four, _mm_mul_ps(_mm_sub_ps(R, G), inv));
+    __m128 hue = select4(_mm_cmpeq_ps(R, maxc), hr, select4(_mm_cmpeq_ps(G, maxc), hg, hb));
+    hue = _mm_and_ps(colored, _mm_mul_ps(hue, sixty));
+    hue = _mm_add_ps(hue, _mm_and_ps(_mm_cmplt_ps(hue, zero), full));
+
+    _mm_storeu_ps(h + i, hue);
+    _mm_storeu_ps(s + i, S);
+    _mm_storeu_ps(v + i, maxc);
+  }
+#endif
+
+  for (; i < n; i++)
+    hsvFromRgb(r[i], g[i], b[i], h[i], s[i], v[i]);
+}
+
+void hsvToRgbPlanar(const float* h, const float* s, const float* v, int n, float* r, float* g, float* b) {
+  int i = 0;
+
+#ifdef __SSE2__
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 four = _mm_set1_ps(4.0f);
+  const __m128 six = _mm_set1_ps(6.0f);
+  const __m128 sixth = _mm_set1_ps(1.0f / 6.0f);
+  const __m128 sextant = _mm_set1_ps(1.0f / 60.0f);
+  const __m128 channel[3] = { _mm_set1_ps(5.0f), _mm_set1_ps(3.0f), _mm_set1_ps(1.0f) };
+  float* out[3] = { r, g, b };
+
+  for (; i + 4 <= n; i += 4) {
+    __m128 S = _mm_loadu_ps(s + i);
+    __m128 V = _mm_loadu_ps(v + i);
+
+    //wrap the hue to 0 - 6. truncation rounds towards zero, so step down where it rounded up
+    __m128 h6 = _mm_mul_ps(_mm_loadu_ps(h + i), sextant);
+    __m128 q = _mm_mul_ps(h6, sixth);
+    __m128 fl = _mm_cvtepi32_ps(_mm_cvttps_epi32(q));
+    fl = _mm_sub_ps(fl, _mm_and_ps(_mm_cmpgt_ps(fl, q), one));
+    h6 = _mm_sub_ps(h6, _mm_mul_ps(six, fl));
+
+    __m128 vs = _mm_mul_ps(V, S);
+    for (int c = 0; c < 3; c++) {
+      __m128 k = _mm_add_ps(channel[c], h6);
+      k = _mm_sub_ps(k, _mm_and_ps(_mm_cmpge_ps(k, six), six));
+      __m128 t = _mm_min_ps(k, _mm_sub_ps(four, k));
+      t = _mm_max_ps(_mm_min_ps(t, one), zero);
+      _mm_storeu_ps(out[c] + i, _mm_sub_ps(V, _mm_mul_ps(vs, t)));
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    float h6 = hueSextant(h[i]);
+    r[i] = rgbChannel(5.0f, h6, s[i], v[i]);
+    g[i] = rgbChannel(3.0f, h6, s[i], v[i]);
+    b[i] = rgbChannel(1.0f, h6, s[i], v[i]);
+  }
+}
+
+//interleaved input is converted in blocks that fit in the cache, through the planar SIMD path
+#define BLOCK 256
+
+void rgbToHsvPixels(const unsigned char* rgb, int channels, int n, float* h, float* s, float* v) {
+  const float* unit = unitTable();
+  float r[BLOCK], g[BLOCK], b[BLOCK];
+
+  for (int start = 0; start < n; start += BLOCK) {
+    int count = n - start < BLOCK ? n - start : BLOCK;
+    const unsigned char* p = rgb + (long)start * channels;
+    for (int i = 0; i < count; i++, p += channels) {
+      r[i] = unit[p[0]];
+      g[i] = unit[p[channels > 2 ? 1 : 0]];
+      b[i] = unit[p[channels > 2 ? 2 : 0]];
+    }
+    rgbToHsvPlanar(r, g, b, count, h + start, s + start, v + start);
+  }
+}
+
+void rgbToHsvInterleaved(const unsigned char* rgb, int channels, int n, float* hsv) {
+  float h[BLOCK], s[BLOCK], v[BLOCK];
+
+  for (int start = 0; start < n; start += BLOCK) {
+    int count = n - start < BLOCK ? n - start : BLOCK;
+    rgbToHsvPixels(rgb + (long)start * channels, channels, count, h, s, v);
+    float* out = hsv + (long)start * 3;
+    for (int i = 0; i < count; i++) {
+      out[3 * i] = h[i];
+      out[3 * i + 1] = s[i];
+      out[3 * i + 2] = v[i];
+    }
+  }
+}
+
+/*
+  8 bit HSV is computed in integers. With x = 255 * delta / max and x = hue / 2 as exact fractions,
+  round(x) = floor((2 * numerator + denominator) / (2 * denominator)), and the divide by 2 * k, k < 256,
+  is replaced by a multiply with ceil(2^32 / (2 * k)) and a shift. The numerators stay below 2^17 and the
+  divisors below 2^9, so the product with the rounded up reciprocal never crosses an integer boundary
+  and the quotient is exact.
+*/
+struct ReciprocalTable {
+  unsigned long long value[256];
+  ReciprocalTable() {
+    value[0] = 0;
+    for (int k = 1; k < 256; k++)
+      value[k] = ((1ULL << 32) + 2 * k - 1) / (2 * k);
+  }
+};
+
+static inline int divide2k(const unsigned long long* reciprocal, unsigned int x, int k) {
+  return (int)((x * reciprocal[k]) >> 32);
+}
+
+void rgbToHsv8(const unsigned char* rgb, int channels, int n, unsigned char* hsv) {
+  static ReciprocalTable table;
+  const unsigned long long* reciprocal = table.value;
+
+  for (int i = 0; i < n; i++, rgb += channels, hsv += 3) {
+    int r = rgb[0];
+    int g = rgb[channels > 2 ? 1 : 0];
+    int b = rgb[channels > 2 ? 2 : 0];
+
+    int maxc = r > g ? r : g;
+    maxc = maxc > b ? maxc : b;
+    int minc = r < g ? r : g;
+    minc = minc < b ? minc : b;
+    int delta = maxc - minc;
+
+    int h = 0, s = 0;
+    if(delta > 0) {
+      //hue / 2 = 30 * num / delta + 30 * offset, plus 180 if that is negative
+      int num, offset;
+      if(r == maxc) {
+        num = g - b;
+        offset = 0;
+      }
+      else if(g == maxc) {
+        num = b - r;
+        offset = 2;
+      }
+      else {
+        num = r - g;
+        offset = 4;
+      }
+      int wrap = num < 0 && offset == 0 ? 360 : 0;
+
+      h = divide2k(reciprocal, 60 * num + delta * (60 * offset + wrap + 1), delta);
+      h = h == 180 ? 0 : h;
+      s = divide2k(reciprocal, 510 * delta + maxc, maxc);
+    }
+
+    hsv[0] = h;
+    hsv[1] = s;
+    hsv[2] = maxc;
+  }
+}
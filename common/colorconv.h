@@ -0,0 +1,29 @@
+// colorconv.h
+// RGB <-> HSV conversion shared by the projects, one pixel at a time or over whole arrays.
+// Hue is on scale 0 - 360, saturation and value on scale 0 - 1, unless noted otherwise.
+
+#ifndef _COLORCONV_INCLUDED_
+#define _COLORCONV_INCLUDED_
+
+//single pixel conversions, written without branches. rgbToHsv matches the classic sector
+//formula up to float rounding, hsvToRgb rounds each channel to the nearest 0 - 255 value
+void rgbToHsv(unsigned char r, unsigned char g, unsigned char b, float &h, float &s, float &v);
+void hsvToRgb(float h, float s, float v, unsigned char &r, unsigned char &g, unsigned char &b);
+
+//converts n interleaved pixels of channels bytes each (3 for RGB, 4 for RGBA, ...) from rgb,
+//into planar h, s and v arrays
+void rgbToHsvPixels(const unsigned char* rgb, int channels, int n, float* h, float* s, float* v);
+
+//converts n interleaved pixels into interleaved h, s, v triples
+void rgbToHsvInterleaved(const unsigned char* rgb, int channels, int n, float* hsv);
+
+//planar conversions with r, g, b on scale 0 - 1. these run four pixels at a time with SSE2 when
+//it is available, and the arrays may not overlap
+void rgbToHsvPlanar(const float* r, const float* g, const float* b, int n, float* h, float* s, float* v);
+void hsvToRgbPlanar(const float* h, const float* s, const float* v, int n, float* r, float* g, float* b);
+
+//table driven conversion to 8 bit HSV: h on scale 0 - 179 (two degrees per step), s and v on
+//scale 0 - 255. every result is the exactly rounded value of the true HSV color
+void rgbToHsv8(const unsigned char* rgb, int channels, int n, unsigned char* hsv);
+
+#endif
@@ -0,0 +1,269 @@
+// mat.h
+// Fixed size vectors and square matrices of float or double, for the transforms in the warp loops.
+// Everything is inline and constexpr, so transforms built from constants compose at compile time.
+
+#ifndef _MAT_INCLUDED_
+#define _MAT_INCLUDED_
+
+#include <cmath>
+
+//alignment of N T's: their size rounded up to a power of two, up to the 32 bytes of an AVX register,
+//so a Vec<3, float> loads as one SSE vector and a Vec<4, double> as one AVX vector
+constexpr int vecAlign(int bytes) {
+  int align = 1;
+  while(align < bytes && align < 32) {
+    align *= 2;
+  }
+  return align;
+}
+
+//column vector of N T's. a transform of dimension N - 1 takes points as Vec<N - 1, T>, which are
+//extended with a 1
+template <int N, typename T>
+struct alignas(vecAlign(N * sizeof(T))) Vec {
+  T v[N];
+
+  constexpr Vec() : v{} {}
+  template <typename... A>
+  constexpr Vec(T first, A... rest) : v{first, T(rest)...} {
+    static_assert(sizeof...(A) + 1 == N, "a Vec is built from exactly N coordinates");
+  }
+
+  constexpr T &operator[](int i) { return v[i]; }
+  constexpr const T &operator[](int i) const { return v[i]; }
+
+  constexpr Vec operator+(const Vec &b) const {
+    Vec r;
+    for(int i = 0; i < N; i++) {
+      r.v[i] = v[i] + b.v[i];
+    }
+    return r;
+  }
+  constexpr Vec operator-(const Vec &b) const {
+    Vec r;
+    for(int i = 0; i < N; i++) {
+      r.v[i] = v[i] - b.v[i];
+    }
+    return r;
+  }
+  constexpr Vec operator*(T s) const {
+    Vec r;
+    for(int i = 0; i < N; i++) {
+      r.v[i] = v[i] * s;
+    }
+    return r;
+  }
+};
+
+template <int N, typename T>
+constexpr T dot(const Vec<N, T> &a, const Vec<N, T> &b) {
+  T sum = 0;
+  for(int i = 0; i < N; i++) {
+    sum += a.v[i] * b.v[i];
+  }
+  return sum;
+}
+
+//the point a homogeneous vector stands for, dividing through by its last coordinate
+template <int N, typename T>
+constexpr Vec<N - 1, T> project(const Vec<N, T> &h) {
+  Vec<N - 1, T> p;
+  T w = 1 / h.v[N - 1];
+  for(int i = 0; i < N - 1; i++) {
+    p.v[i] = h.v[i] * w;
+  }
+  return p;
+}
+
+//N x N matrix, stored by rows. a new one is the identity
+template <int N, typename T>
+struct Mat {
+  Vec<N, T> row[N];
+
+  constexpr Mat() : row{} {
+    for(int i = 0; i < N; i++) {
+      row[i].v[i] = 1;
+    }
+  }
+
+  //from an array of coefficients by rows, or from a matrix of the other precision
+  constexpr explicit Mat(const T (&coefs)[N][N]) : row{} {
+    for(int i = 0; i < N; i++) {
+      for(int j = 0; j < N; j++) {
+        row[i].v[j] = coefs[i][j];
+      }
+    }
+  }
+  template <typename U>
+  constexpr explicit Mat(const Mat<N, U> &m) : row{} {
+    for(int i = 0; i < N; i++) {
+      for(int j = 0; j < N; j++) {
+        row[i].v[j] = (T)m.row[i].v[j];
+      }
+    }
+  }
+
+  constexpr Vec<N, T> &operator[](int i) { return row[i]; }
+  constexpr const Vec<N, T> &operator[](int i) const { return row[i]; }
+
+  constexpr Vec<N, T> column(int j) const {
+    Vec<N, T> c;
+    for(int i = 0; i < N; i++) {
+      c.v[i] = row[i].v[j];
+    }
+    return c;
+  }
+
+  constexpr Vec<N, T> operator*(const Vec<N, T> &x) const {
+    Vec<N, T> r;
+    for(int i = 0; i < N; i++) {
+      r.v[i] = dot(row[i], x);
+    }
+    return r;
+  }
+
+  //the homogeneous image of a point, which is extended with a 1
+  constexpr Vec<N, T> operator*(const Vec<N - 1, T> &p) const {
+    Vec<N, T> r;
+    for(int i = 0; i < N; i++) {
+      T sum = 0;
+      for(int j = 0; j < N - 1; j++) {
+        sum += row[i].v[j] * p.v[j];
+      }
+      r.v[i] = sum + row[i].v[N - 1];
+    }
+    return r;
+  }
+
+  constexpr Mat operator*(const Mat &b) const {
+    Mat r;
+    for(int i = 0; i < N; i++) {
+      for(int j = 0; j < N; j++) {
+        T sum = 0;
+        for(int k = 0; k < N; k++) {
+          sum += row[i].v[k] * b.row[k].v[j];
+        }
+        r.row[i].v[j] = sum;
+      }
+    }
+    return r;
+  }
+
+  constexpr bool operator==(const Mat &b) const {
+    for(int i = 0; i < N; i++) {
+      for(int j = 0; j < N; j++) {
+        if(row[i].v[j] != b.row[i].v[j]) {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+  constexpr bool operator!=(const Mat &b) const { return !(*this == b); }
+};
+
+template <int N, typename T>
+constexpr Mat<N, T> transpose(const Mat<N, T> &m) {
+  Mat<N, T> t;
+  for(int i = 0; i < N; i++) {
+    for(int j = 0; j < N; j++) {
+      t.row[i].v[j] = m.row[j].v[i];
+    }
+  }
+  return t;
+}
+
+template <typename T>
+constexpr T determinant(const Mat<3, T> &m) {
+  T det = m[0][0] * m[1][1] * m[2][2];
+  det += m[0][1] * m[1][2] * m[2][0];
+  det += m[0][2] * m[2][1] * m[1][0];
+  det -= m[2][0] * m[1][1] * m[0][2];
+  det -= m[1][0] * m[0][1] * m[2][2];
+  det -= m[0][0] * m[1][2] * m[2][1];
+  return det;
+}
+
+template <typename T>
+constexpr Mat<3, T> adjoint(const Mat<3, T> &m) {
+  Mat<3, T> adj;
+  adj[0][0] = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+  adj[0][1] = m[0][2] * m[2][1] - m[0][1] * m[2][2];
+  adj[0][2] = m[0][1] * m[1][2] - m[0][2] * m[1][1];
+  adj[1][0] = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+  adj[1][1] = m[0][0] * m[2][2] - m[0][2] * m[2][0];
+  adj[1][2] = m[0][2] * m[1][0] - m[0][0] * m[1][2];
+  adj[2][0] = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+  adj[2][1] = m[0][1] * m[2][0] - m[0][0] * m[2][1];
+  adj[2][2] = m[0][0] * m[1][1] - m[0][1] * m[1][0];
+  return adj;
+}
+
+//the adjoint divided through by the determinant, which is infinite or NaN for a singular matrix
+template <typename T>
+constexpr Mat<3, T> inverse(const Mat<3, T> &m) {
+  Mat<3, T> inv = adjoint(m);
+  T det = determinant(m);
+  for(int i = 0; i < 3; i++) {
+    for(int j = 0; j < 3; j++) {
+      inv[i][j] /= det;
+    }
+  }
+  return inv;
+}
+
+//2D transforms as 3 x 3 homogeneous matrices
+template <typename T>
+constexpr Mat<3, T> translation(T dx, T dy) {
+  Mat<3, T> m;
+  m[0][2] = dx;
+  m[1][2] = dy;
+  return m;
+}
+
+template <typename T>
+constexpr Mat<3, T> scaling(T sx, T sy) {
+  Mat<3, T> m;
+  m[0][0] = sx;
+  m[1][1] = sy;
+  return m;
+}
+
+template <typename T>
+constexpr Mat<3, T> shearing(T hx, T hy) {
+  Mat<3, T> m;
+  m[0][1] = hx;
+  m[1][0] = hy;
+  return m;
+}
+
+//counter clockwise by the angle whose cosine and sine are given, so constant angles can be folded
+//from constant cosines and sines
+template <typename T>
+constexpr Mat<3, T> rotation(T cosine, T sine) {
+  Mat<3, T> m;
+  m[0][0] = cosine;
+  m[0][1] = -sine;
+  m[1][0] = sine;
+  m[1][1] = cosine;
+  return m;
+}
+
+template <typename T>
+inline Mat<3, T> rotation(T radians) {
+  return rotation(std::cos(radians), std::sin(radians));
+}
+
+typedef Vec<2, float> Vec2f;
+typedef Vec<3, float> Vec3f;
+typedef Vec<2, double> Vec2d;
+typedef Vec<3, double> Vec3d;
+typedef Mat<3, float> Mat3f;
+typedef Mat<3, double> Mat3d;
+
+//a translation, scale and quarter turn built from constants must fold at compile time
+static_assert(translation(3.0f, 4.0f) * scaling(0.5f, 0.5f) * rotation(0.0f, 1.0f) ==
+              Mat3f({{0.0f, -0.5f, 3.0f}, {0.5f, 0.0f, 4.0f}, {0.0f, 0.0f, 1.0f}}),
+              "constant transforms do not compose at compile time");
+
+#endif
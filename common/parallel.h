@@ -0,0 +1,141 @@
+// parallel.h
+// Helpers for splitting per-row image work across hardware threads.
+
+#ifndef _PARALLEL_INCLUDED_
+#define _PARALLEL_INCLUDED_
+
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//true on a thread that is running work handed out by parallelRows or parallelTasks
+inline bool &inParallelWork() {
+  static thread_local bool inside = false;
+  return inside;
+}
+
+//number of worker threads to use, never less than one. work that is already running in parallel
+//gets one, so nested helpers run serially rather than oversubscribing the machine
+inline int numThreads() {
+  if(inParallelWork()) {
+    return 1;
+  }
+  unsigned int n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : (int)n;
+}
+
+//calls work(args...) with inParallelWork() set for its duration
+template <typename F, typename... Args>
+void runAsParallelWork(F &work, Args... args) {
+  bool outer = inParallelWork();
+  inParallelWork() = true;
+  work(args...);
+  inParallelWork() = outer;
+}
+
+//calls work(rowBegin, rowEnd) on contiguous bands of rows covering [0, rows), one band per thread.
+//the calling thread runs the last band itself so a single band never spawns a thread
+template <typename F>
+void parallelRows(int rows, F work) {
+  int threads = numThreads();
+  if(threads > rows) {
+    threads = rows;
+  }
+  if(threads <= 1) {
+    if(rows > 0) {
+      work(0, rows);
+    }
+    return;
+  }
+
+  int band = (rows + threads - 1) / threads;
+  std::vector<std::thread> pool;
+  for(int begin = 0; begin + band < rows; begin += band) {
+    pool.emplace_back([&work, begin, band]() { runAsParallelWork(work, begin, begin + band); });
+  }
+  runAsParallelWork(work, (int)pool.size() * band, rows);
+
+  for(auto &t : pool) {
+    t.join();
+  }
+}
+
+//calls work(task) for every task in [0, tasks), with work stealing. each thread starts with its own
+//contiguous run of tasks, so neighbouring tasks stay on one thread, and works through it from the
+//front. a thread whose run is done steals the back half of the longest run left, so uneven tasks
+//still balance. the calling thread works through a run too
+template <typename F>
+void parallelTasks(int tasks, F work) {
+  int threads = numThreads();
+  if(threads > tasks) {
+    threads = tasks;
+  }
+  if(threads <= 1) {
+    for(int task = 0; task < tasks; task++) {
+      work(task);
+    }
+    return;
+  }
+
+  struct Run {
+    std::mutex lock;
+    int begin, end;
+  };
+  std::vector<Run> runs(threads);
+  for(int i = 0; i < threads; i++) {
+    runs[i].begin = (int)((long long)tasks * i / threads);
+    runs[i].end = (int)((long long)tasks * (i + 1) / threads);
+  }
+
+  auto worker = [&](int self) {
+    for(;;) {
+      int task = -1;
+      {
+        std::lock_guard<std::mutex> hold(runs[self].lock);
+        if(runs[self].begin < runs[self].end) {
+          task = runs[self].begin++;
+        }
+      }
+      if(task >= 0) {
+        work(task);
+        continue;
+      }
+
+      int victim = -1, most = 0;
+      for(int i = 0; i < threads; i++) {
+        std::lock_guard<std::mutex> hold(runs[i].lock);
+        if(runs[i].end - runs[i].begin > most) {
+          most = runs[i].end - runs[i].begin;
+          victim = i;
+        }
+      }
+      if(victim < 0) {
+        return;
+      }
+
+      //the run may have shrunk since it was looked at, or been finished
+      int begin, end;
+      {
+        std::lock_guard<std::mutex> hold(runs[victim].lock);
+        end = runs[victim].end;
+        begin = end - (end - runs[victim].begin + 1) / 2;
+        runs[victim].end = begin;
+      }
+      std::lock_guard<std::mutex> hold(runs[self].lock);
+      runs[self].begin = begin;
+      runs[self].end = end;
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for(int i = 1; i < threads; i++) {
+    pool.emplace_back([&worker, i]() { runAsParallelWork(worker, i); });
+  }
+  runAsParallelWork(worker, 0);
+
+  for(auto &t : pool) {
+    t.join();
+  }
+}
+
+#endif
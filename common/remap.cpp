@@ -0,0 +1,322 @@
+// remap.cpp
+// Remap tables: building them, saving and mapping them, and gathering frames through them.
+
+#include "remap.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+//start of a remap table file. the entries or grid nodes follow it directly
+struct RemapHeader {
+  char magic[8];
+  int32_t width, height, inWidth, inHeight, grid, kind, nearest, reserved;
+  double map[9];
+};
+
+static const char REMAP_MAGIC[8] = {'R', 'E', 'M', 'A', 'P', '0', '2', '\n'};
+
+RemapKey::RemapKey() : kind(0), nearest(0) {
+  for(int i = 0; i < 9; i++) {
+    map[i] = 0;
+  }
+}
+
+bool RemapKey::operator==(const RemapKey &other) const {
+  return memcmp(map, other.map, sizeof(map)) == 0 && kind == other.kind && nearest == other.nearest;
+}
+
+RemapTable::RemapTable() : width(0), height(0), inWidth(0), inHeight(0), grid(1),
+                           entries(NULL), nodes(NULL), mapped(NULL), mappedSize(0) {}
+
+RemapTable::~RemapTable() {
+  if(mapped) {
+    munmap(mapped, mappedSize);
+  }
+}
+
+//drops whatever the table held, mapped or built
+static void release(RemapTable &table) {
+  if(table.mapped) {
+    munmap(table.mapped, table.mappedSize);
+    table.mapped = NULL;
+  }
+  table.storage.clear();
+  table.width = table.height = table.inWidth = table.inHeight = 0;
+  table.entries = NULL;
+  table.nodes = NULL;
+}
+
+static bool validSize(int size) {
+  return size >= 1 && size <= REMAP_MAX_SIZE;
+}
+
+//bytes of entries or nodes a table holds
+static size_t payloadSize(const RemapTable &table) {
+  if(table.grid == 1) {
+    return (size_t)table.width * table.height * sizeof(RemapEntry);
+  }
+  return (size_t)table.nodesX() * table.nodesY() * 2 * sizeof(float);
+}
+
+//points the table at its payload
+static void attach(RemapTable &table, const unsigned char *payload) {
+  table.entries = table.grid == 1 ? (const RemapEntry *)payload : NULL;
+  table.nodes = table.grid == 1 ? NULL : (const float *)payload;
+}
+
+//fixed point entry for source position (u, v), in pixel center coordinates, or for the nearest
+//pixel, the one that the corner position (u, v) falls in. the sizes are at most REMAP_MAX_SIZE, so
+//every position inside the source fits, and NaN fails the test too
+static inline RemapEntry toEntry(double u, double v, int inWidth, int inHeight, bool nearest) {
+  RemapEntry e;
+  e.fu = e.fv = 0;
+  if(nearest) {
+    if(!(u > -1 && u < inWidth && v > -1 && v < inHeight)) {
+      e.u = REMAP_OUTSIDE;
+      e.v = 0;
+      return e;
+    }
+    e.u = (int16_t)u;
+    e.v = (int16_t)v;
+    return e;
+  }
+  if(!(u >= -0.5 && u < inWidth - 0.5 && v >= -0.5 && v < inHeight - 0.5)) {
+    e.u = REMAP_OUTSIDE;
+    e.v = 0;
+    return e;
+  }
+  int fixedU = (int)floor(u * 256 + 0.5), fixedV = (int)floor(v * 256 + 0.5);
+  e.u = (int16_t)(fixedU >> 8);
+  e.v = (int16_t)(fixedV >> 8);
+  e.fu = (uint8_t)(fixedU & 255);
+  e.fv = (uint8_t)(fixedV & 255);
+  return e;
+}
+
+bool buildRemap(RemapTable &table, int width, int height, int inWidth, int inHeight, int grid,
+                const RemapKey &key, InverseMap inverse) {
+  release(table);
+  if(!validSize(width) || !validSize(height) || !validSize(inWidth) || !validSize(inHeight)) {
+    return false;
+  }
+  table.width = width;
+  table.height = height;
+  table.inWidth = inWidth;
+  table.inHeight = inHeight;
+  table.grid = grid < 1 ? 1 : (grid > REMAP_MAX_SIZE ? REMAP_MAX_SIZE : grid);
+  table.key = key;
+  table.storage.assign(payloadSize(table), 0);
+  attach(table, &table.storage[0]);
+
+  //bilinear entries and nodes are kept in pixel center coordinates, so the gather needs no half
+  //pixel shift. nearest ones are kept at pixel corners, which are truncated
+  bool nearest = key.nearest != 0;
+  double offset = nearest ? 0 : 0.5;
+  if(table.grid == 1) {
+    RemapEntry *entries = (RemapEntry *)&table.storage[0];
+    parallelRows(height, [&](int rowBegin, int rowEnd) {
+      for(int y = rowBegin; y < rowEnd; y++) {
+        for(int x = 0; x < width; x++) {
+          double u, v;
+          inverse(x + offset, y + offset, u, v);
+          entries[(size_t)y * width + x] = toEntry(u - offset, v - offset, inWidth, inHeight, nearest);
+        }
+      }
+    });
+  }
+  else {
+    float *nodes = (float *)&table.storage[0];
+    int nodesX = table.nodesX();
+    parallelRows(table.nodesY(), [&](int rowBegin, int rowEnd) {
+      for(int j = rowBegin; j < rowEnd; j++) {
+        for(int i = 0; i < nodesX; i++) {
+          double u, v;
+          inverse(i * table.grid + offset, j * table.grid + offset, u, v);
+          nodes[2 * ((size_t)j * nodesX + i)] = u - offset;
+          nodes[2 * ((size_t)j * nodesX + i) + 1] = v - offset;
+        }
+      }
+    });
+  }
+  return true;
+}
+
+bool saveRemap(const RemapTable &table, string filename) {
+  FILE *file = fopen(filename.c_str(), "wb");
+  if(!file) {
+    return false;
+  }
+  RemapHeader header;
+  memcpy(header.magic, REMAP_MAGIC, sizeof(header.magic));
+  header.width = table.width;
+  header.height = table.height;
+  header.inWidth = table.inWidth;
+  header.inHeight = table.inHeight;
+  header.grid = table.grid;
+  header.kind = table.key.kind;
+  header.nearest = table.key.nearest;
+  header.reserved = 0;
+  memcpy(header.map, table.key.map, sizeof(header.map));
+
+  const void *payload = table.grid == 1 ? (const void *)table.entries : (const void *)table.nodes;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(payload, 1, payloadSize(table), file) == payloadSize(table);
+  return fclose(file) == 0 && ok;
+}
+
+bool loadRemap(RemapTable &table, string filename, const RemapKey &key) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0) {
+    return false;
+  }
+  struct stat info;
+  void *mapped = MAP_FAILED;
+  if(fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(RemapHeader)) {
+    mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if(mapped == MAP_FAILED) {
+    return false;
+  }
+
+  //the header must be ours, for this key, with sizes a table can have, and the file exactly as long
+  //as the table it describes. the entries themselves are not read here, the gather clamps them
+  RemapHeader header;
+  memcpy(&header, mapped, sizeof(header));
+  RemapTable described;
+  described.width = header.width;
+  described.height = header.height;
+  described.grid = header.grid;
+  memcpy(described.key.map, header.map, sizeof(header.map));
+  described.key.kind = header.kind;
+  described.key.nearest = header.nearest;
+  if(memcmp(header.magic, REMAP_MAGIC, sizeof(header.magic)) != 0 || !(described.key == key) ||
+     !validSize(header.width) || !validSize(header.height) || !validSize(header.inWidth) ||
+     !validSize(header.inHeight) || !validSize(header.grid) ||
+     (size_t)info.st_size != sizeof(RemapHeader) + payloadSize(described)) {
+    munmap(mapped, info.st_size);
+    return false;
+  }
+
+  release(table);
+  table.width = header.width;
+  table.height = header.height;
+  table.inWidth = header.inWidth;
+  table.inHeight = header.inHeight;
+  table.grid = header.grid;
+  table.key = key;
+  table.mapped = mapped;
+  table.mappedSize = info.st_size;
+  attach(table, (const unsigned char *)mapped + sizeof(RemapHeader));
+  return true;
+}
+
+//(1 - w) a + w b for two RGBA pixels and w in 256ths. red and blue, then green and alpha, are
+//blended together as pairs of 16 bit lanes of one 32 bit word
+static inline uint32_t blend(uint32_t a, uint32_t b, uint32_t w) {
+  uint32_t rb = (((a & 0x00ff00ff) * (256 - w) + (b & 0x00ff00ff) * w + 0x00800080) >> 8) & 0x00ff00ff;
+  uint32_t ga = (((a >> 8) & 0x00ff00ff) * (256 - w) + ((b >> 8) & 0x00ff00ff) * w + 0x00800080) & 0xff00ff00;
+  return rb | ga;
+}
+
+static inline int clampIndex(int i, int n) {
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+//gathers n output pixels through their entries. taps past the edges of the source repeat the edge,
+//so entries from a damaged file still only read the source
+static void gatherRow(const uint32_t *const *in, int inWidth, int inHeight, const RemapEntry *entries,
+                      int n, uint32_t *out) {
+  for(int x = 0; x < n; x++) {
+    RemapEntry e = entries[x];
+    if(e.u == REMAP_OUTSIDE) {
+      out[x] = 0;
+      continue;
+    }
+    int u0 = clampIndex(e.u, inWidth), u1 = clampIndex(e.u + 1, inWidth);
+    int v0 = clampIndex(e.v, inHeight), v1 = clampIndex(e.v + 1, inHeight);
+    const uint32_t *row0 = in[v0], *row1 = in[v1];
+    out[x] = blend(blend(row0[u0], row0[u1], e.fu), blend(row1[u0], row1[u1], e.fu), e.fv);
+  }
+}
+
+void remapPixels(const RemapTable &table, const uint32_t *const *in, uint32_t **out) {
+  int width = table.width, grid = table.grid;
+  if(grid == 1) {
+    parallelRows(table.height, [&](int rowBegin, int rowEnd) {
+      for(int y = rowBegin; y < rowEnd; y++) {
+        gatherRow(in, table.inWidth, table.inHeight, table.entries + (size_t)y * width, width, out[y]);
+      }
+    });
+    return;
+  }
+
+  //the rows of a coarse grid are expanded to entries a row at a time, interpolating the nodes
+  //first down to the row, then stepping along it between them in fixed point with GRID_BITS
+  //fractional bits, which leaves no more than grid / 2^GRID_BITS of a pixel of drift. nodes that
+  //are not finite, or too far off the source for the fixed point, leave their cells outside
+  const int GRID_BITS = 12;
+  const float one = 1 << GRID_BITS, far = 4.0f * REMAP_MAX_SIZE;
+  bool nearest = table.key.nearest != 0;
+  int nodesX = table.nodesX();
+  int loU = nearest ? -(1 << GRID_BITS) : -(1 << (GRID_BITS - 1));
+  int hiU = (table.inWidth << GRID_BITS) + (nearest ? 0 : loU);
+  int loV = loU, hiV = (table.inHeight << GRID_BITS) + (nearest ? 0 : loV);
+  parallelRows(table.height, [&](int rowBegin, int rowEnd) {
+    vector<float> rowNodes(2 * nodesX);
+    vector<RemapEntry> entries(width);
+    for(int y = rowBegin; y < rowEnd; y++) {
+      int j = y / grid;
+      float t = (float)(y - j * grid) / grid;
+      const float *below = table.nodes + 2 * (size_t)j * nodesX, *above = below + 2 * nodesX;
+      for(int i = 0; i < 2 * nodesX; i++) {
+        rowNodes[i] = below[i] + t * (above[i] - below[i]);
+      }
+
+      for(int x0 = 0; x0 < width; x0 += grid) {
+        const float *left = &rowNodes[x0 / grid * 2];
+        int x1 = x0 + grid < width ? x0 + grid : width;
+        if(!(fabsf(left[0]) < far && fabsf(left[1]) < far && fabsf(left[2]) < far && fabsf(left[3]) < far)) {
+          for(int x = x0; x < x1; x++) {
+            entries[x].u = REMAP_OUTSIDE;
+          }
+          continue;
+        }
+        int u = (int)lrintf(left[0] * one), v = (int)lrintf(left[1] * one);
+        int du = (int)lrintf((left[2] - left[0]) * one / grid), dv = (int)lrintf((left[3] - left[1]) * one / grid);
+        for(int x = x0; x < x1; x++, u += du, v += dv) {
+          RemapEntry &e = entries[x];
+          if(nearest) {
+            if(u <= loU || u >= hiU || v <= loV || v >= hiV) {
+              e.u = REMAP_OUTSIDE;
+              continue;
+            }
+            e.u = (int16_t)(u >> GRID_BITS);
+            e.v = (int16_t)(v >> GRID_BITS);
+            e.fu = e.fv = 0;
+            continue;
+          }
+          if(u < loU || u >= hiU || v < loV || v >= hiV) {
+            e.u = REMAP_OUTSIDE;
+            continue;
+          }
+          int fixedU = (u + (1 << (GRID_BITS - 9))) >> (GRID_BITS - 8);
+          int fixedV = (v + (1 << (GRID_BITS - 9))) >> (GRID_BITS - 8);
+          e.u = (int16_t)(fixedU >> 8);
+          e.v = (int16_t)(fixedV >> 8);
+          e.fu = (uint8_t)(fixedU & 255);
+          e.fv = (uint8_t)(fixedV & 255);
+        }
+      }
+      gatherRow(in, table.inWidth, table.inHeight, &entries[0], width, out[y]);
+    }
+  });
+}
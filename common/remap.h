@@ -0,0 +1,91 @@
+// remap.h
+// Remap tables: a warp's inverse map evaluated once, then applied to any number of frames of the
+// same size as a pure gather and bilinear blend (or nearest pixel copy).
+
+#ifndef _REMAP_INCLUDED_
+#define _REMAP_INCLUDED_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+//source position of one output pixel in fixed point. (u, v) is the source pixel at or to the lower
+//left of the point, fu and fv how far past it the point is in 256ths, which are the bilinear weights
+struct RemapEntry {
+  int16_t u, v;
+  uint8_t fu, fv;
+};
+
+//u of an output pixel whose point falls outside the source. it is left transparent black
+#define REMAP_OUTSIDE INT16_MIN
+
+//largest output or source width or height a table can be built for, as entries hold 16 bit pixels
+#define REMAP_MAX_SIZE INT16_MAX
+
+//what a table was built for. it is kept in the table's file, so a table is only reused for the warp
+//it was made from: the caller's description of the inverse map, and how the source is sampled
+struct RemapKey {
+  double map[9];    //the map's coefficients, such as its inverse matrix, laid out as the caller likes
+  int32_t kind;     //the caller's kind of map, so maps with the same coefficients are told apart
+  int32_t nearest;  //1 to copy the pixel a pixel's corner falls in, 0 to blend four at its center
+
+  RemapKey();
+  bool operator==(const RemapKey &other) const;
+};
+
+//a remap table, built in memory or mapped from a file. either it holds one entry per output pixel
+//(grid 1), or the source position of every grid-th pixel in each direction, which the pixels between
+//are interpolated from when the table is applied. a coarse grid is far smaller, and exact for affine
+//warps, but bends smooth warps between its nodes
+struct RemapTable {
+  int width, height;        //output size
+  int inWidth, inHeight;    //size of the source it maps into
+  int grid;                 //1, or the spacing of the grid nodes
+  RemapKey key;             //the warp and sampling the table was built for
+  const RemapEntry *entries;  //width x height entries, row by row, when grid is 1
+  const float *nodes;         //(u, v) pairs, nodesX() x nodesY() of them, when grid is more than 1
+
+  RemapTable();
+  ~RemapTable();
+
+  int nodesX() const { return (width + grid - 1) / grid + 1; }
+  int nodesY() const { return (height + grid - 1) / grid + 1; }
+
+  std::vector<unsigned char> storage;  //contents of a table that was built rather than mapped
+  void *mapped;                        //the file a table was mapped from, and its size
+  size_t mappedSize;
+
+private:
+  RemapTable(const RemapTable &);
+  RemapTable &operator=(const RemapTable &);
+};
+
+//the inverse map, taking a point in the output to a point in the source. pixel (x, y) covers the
+//square from (x, y) to (x + 1, y + 1) in both
+typedef std::function<void(double x, double y, double &u, double &v)> InverseMap;
+
+//evaluates inverse at the center of every output pixel (or grid node) of a width x height output
+//into table, for a source of inWidth x inHeight, or at the corner of each pixel if key asks for the
+//nearest pixel. fails, leaving table empty, if a size is not from 1 to REMAP_MAX_SIZE. points the
+//map takes to infinity or NaN are outside the source
+bool buildRemap(RemapTable &table, int width, int height, int inWidth, int inHeight, int grid,
+                const RemapKey &key, InverseMap inverse);
+
+//writes table to filename, or maps the table in filename into table without reading it in.
+//loadRemap fails if the file is not a whole remap table, or was built for a different key
+bool saveRemap(const RemapTable &table, std::string filename);
+bool loadRemap(RemapTable &table, std::string filename, const RemapKey &key);
+
+//fills the output rows out from the source rows in, both of 4 byte RGBA pixels
+void remapPixels(const RemapTable &table, const uint32_t *const *in, uint32_t **out);
+
+//remapPixels for pixmaps of any 4 byte RGBA pixel struct
+template <typename P>
+void applyRemap(const RemapTable &table, P **in, P **out) {
+  static_assert(sizeof(P) == sizeof(uint32_t), "remap tables gather 4 byte RGBA pixels");
+  remapPixels(table, (const uint32_t *const *)in, (uint32_t **)out);
+}
+
+#endif
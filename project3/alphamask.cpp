@@ -1,5 +1,8 @@
 // Ryan Painter CPSC 4040
 // This program reads and displays image files. Read images can be color inverted, noisified, and saved.
+#include "keyer.h"
+#include "matte.h"
+
 #include <OpenImageIO/imageio.h>
 #include <iostream>
 
@@ -15,14 +18,6 @@ OIIO_NAMESPACE_USING
 
 static int icolor = 0;
 
-//struct that stores the red, green, blue, and alpha channel of a pixel
-struct pixel {
-  unsigned char red;
-  unsigned char green;
-  unsigned char blue;
-  unsigned char alpha;
-};
-
 struct pixel** pixmap;
 unsigned int width;
 unsigned int height;
@@ -127,94 +122,24 @@ void writeImage(string outfilename){
   }
 }
 
-//provided code for converting from rgb to hsv
-//changed how to access the hsv values after running to fit better with my brain
-
-/*
-Input RGB colo r primary values : r , g, and b on scale 0 - 255
-Output HSV colo rs : h on scale 0-360, s and v on scale -1
-*/
-
-#define maximum(x, y, z) ((x) > (y)? ((x) > (z)? (x) : (z)) : ((y) > (z)? (y) : (z)))
-#define minimum(x, y, z) ((x) < (y)? ((x) < (z)? (x) : (z)) : ((y) < (z)? (y) : (z)))
-
-void RGBtoHSV(int r, int g, int b, double* ret){
-  double red, green, blue;
-  double h, s, v;
-  double max, min, delta;
-  red = r / 255.0; green = g / 255.0; blue = b / 255.0; /* r , g, b to 0 - 1 scale */
-  max = maximum(red, green, blue);
-  min = minimum(red, green, blue);
-  v = max; /* value i s maximum of r , g, b */
-  if (max == 0) { /* saturation and hue 0 i f value i s 0 */
-    s = 0;
-    h = 0;
-  }
-  else {
-    s = (max - min) / max; /* saturation i s colo r pu ri ty on scale 0 - 1 */
-    delta = max - min;
-
-    if (delta == 0) { /* hue doesn't matter i f saturation i s 0 */
-      h = 0;
-    }
-    else{
-      if (red == max) { /* otherwise, determine hue on scale 0 - 360 */
-        h = (green - blue) / delta;
-      }
-      else if (green == max) {
-        h = 2.0 + (blue - red) / delta;
-      }
-      else {/* ( blue == max) */
-        h = 4.0 + (red - green) / delta;
-      }
-
-      h = h * 60.0;
-      if(h < 0) {
-        h = h + 360.0;
-      }
-    }
-  }
-
-  ret[0] = h;
-  ret[1] = s;
-  ret[2] = v;
-}
-
-//these values determine the color to be masked
-#define targetHue 120
-#define hueVariance 55
-
-#define targetSaturation 1
-#define saturationVariance 0.65
-
-#define targetValue 1
-#define valueVariance 0.85
-
-void mask() {
-  double HSV[3];
-
-  for (int r = 0; r < height; r++) {
-    for (int c = 0; c < width; c++) {
-      RGBtoHSV(pixmap[r][c].red, pixmap[r][c].green, pixmap[r][c].blue, HSV);
-
-      //check to see if the color near the color we want to mask and set the alpha to 0 if it is
-      if(HSV[0] < targetHue + hueVariance && HSV[0] > targetHue - hueVariance)
-        if(HSV[1] < targetSaturation + saturationVariance && HSV[1] > targetSaturation - saturationVariance)
-          if(HSV[2] < targetValue + valueVariance && HSV[2] > targetValue - valueVariance)
-            pixmap[r][c].alpha = 0;
-    }
-  }
-}
-
 int main(int argc, char* argv[]) {
-  if(argc != 3) {
-    //throw wrong args error
+  //anything after the output file is a list of matte refinements, applied in order
+  //-m also saves the matte alone as a run-length encoded file that compose can read
+  vector<MatteOp> ops;
+  string rleFile;
+  if(argc < 3 || !parseMatteOps(argc, argv, 3, ops, rleFile)) {
+    cerr << "incorrect usage. correct usage is: \"./alphamask <in> <out> [-e radius] [-d radius] [-f radius] [-m matte.rle] ...\"" << endl;
     return -1;
   }
 
   readImage(argv[1]);
-  mask();
+  mask(pixmap, width, height);
+  refineMatte(pixmap, width, height, ops);
   writeImage(argv[2]);
+
+  if(rleFile != "") {
+    saveMatte(rleFile, pixmap, width, height);
+  }
   
   return 0;
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 // Ryan Painter CPSC 4040
 // This program reads and displays image files. Read images can be color inverted, noisified, and saved.
+#include "matte.h"
+#include "parallel.h"
+
 #include <OpenImageIO/imageio.h>
 #include <iostream>
+#include <cstring>
 
 #ifdef __APPLE__
 #  pragma clang diagnostic ignored "-Wdeprecated-declarations"
@@ -15,14 +19,6 @@ OIIO_NAMESPACE_USING
 
 static int icolor = 0;
 
-//struct that stores the red, green, blue, and alpha channel of a pixel
-struct pixel {
-  unsigned char red;
-  unsigned char green;
-  unsigned char blue;
-  unsigned char alpha;
-};
-
 struct pixel** pixmapA;
 unsigned int widthA;
 unsigned int heightA;
@@ -91,6 +87,7 @@ void readImages(string fileNameA, string fileNameB) {
   widthB = specB.width;
   heightB = specB.height;
   channels = specB.nchannels;
+  pixels.resize(widthB*heightB*channels);
   in->read_image (TypeDesc::UINT8, &pixels[0]);
   in->close ();
 
@@ -158,6 +155,57 @@ void compose() {
   }
 }
 
+//composites image A over image B using the alpha of a run-length matte in place of A's own alpha.
+//the result is built in pixmapB, then pixmapA's rows are pointed at it so display and writing are unchanged.
+//transparent runs only premultiply B, like compose() does, opaque runs are copied and only partial runs are blended
+void composeMatte(const RLEMatte &matte) {
+  parallelRows(heightA, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      int c = 0;
+      for (unsigned int i = matte.rows[r]; i < matte.rows[r + 1]; i++) {
+        const MatteRun &run = matte.runs[i];
+        int end = c + run.length;
+
+        if(run.alpha == 255) {
+          memcpy(&pixmapB[r][c], &pixmapA[r][c], run.length * sizeof(pixel));
+          for (int x = c; x < end; x++)
+            pixmapB[r][x].alpha = 255;
+        }
+        else if(run.alpha == 0) {
+          //B shows through unchanged, but premultiplied like every other composited pixel
+          for (int x = c; x < end; x++) {
+            pixel &B = pixmapB[r][x];
+            if(B.alpha != 255) {
+              double aB = B.alpha / 255.0;
+              B.red = B.red * aB;
+              B.green = B.green * aB;
+              B.blue = B.blue * aB;
+            }
+          }
+        }
+        else {
+          //A over B with a constant alpha for the whole run
+          double aA = run.alpha / 255.0;
+          for (int x = c; x < end; x++) {
+            pixel &A = pixmapA[r][x];
+            pixel &B = pixmapB[r][x];
+            double aB = B.alpha / 255.0;
+            B.red = (A.red * aA + (1 - aA) * B.red * aB);
+            B.green = (A.green * aA + (1 - aA) * B.green * aB);
+            B.blue = (A.blue * aA + (1 - aA) * B.blue * aB);
+            B.alpha = (aA + (1 - aA) * aB) * 255;
+          }
+        }
+
+        c = end;
+      }
+    }
+  });
+
+  for (int r = 0; r < heightA; r++) {
+    pixmapA[r] = pixmapB[r];
+  }
+}
 
 //read the current image in the frame buffer and saves to the file given by the user
 void writeImage(string outfilename){
@@ -268,7 +316,23 @@ int main(int argc, char* argv[]){
   glutDisplayFunc(renderImage);	  // display callback
   glutReshapeFunc(handleReshape); // window resize callback
 
-  if(argc == 3 || argc == 4) {
+  //image A, image B and an optional output file, with "-m matte.rle" anywhere after the images
+  //to use a run-length matte saved by alphamask instead of image A's alpha
+  string outFile, matteFile;
+  for (int i = 3; i < argc; i++) {
+    if(string(argv[i]) == "-m" && i + 1 < argc) {
+      matteFile = argv[++i];
+    }
+    else if(outFile == "" && argv[i][0] != '-') {
+      outFile = argv[i];
+    }
+    else {
+      cout << "Incorrect arguments" << endl;
+      return -1;
+    }
+  }
+
+  if(argc >= 3) {
     cout << "start" << endl;
     readImages(argv[1], argv[2]);
     cout << "read" << endl;
@@ -278,13 +342,26 @@ int main(int argc, char* argv[]){
       return -1;
     }
 
-    compose();
+    if(matteFile != "") {
+      RLEMatte matte;
+      if(!readMatteRLE(matteFile, matte)) {
+        return -1;
+      }
+      if(matte.width != (int)widthA || matte.height != (int)heightA) {
+        cout << "The matte must be the same size as Image A" << endl;
+        return -1;
+      }
+      composeMatte(matte);
+    }
+    else {
+      compose();
+    }
     cout << "composed" << endl;
     renderImage();
     cout << "rendered" << endl;
 
-    if(argc == 4) {
-      writeImage(argv[3]);
+    if(outFile != "") {
+      writeImage(outFile);
     }
   }
   else {
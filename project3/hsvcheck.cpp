@@ -0,0 +1,155 @@
+// hsvcheck.cpp
+// Ryan Painter CPSC 4040
+// Checks the shared RGB <-> HSV conversions against the code they replaced: the keyer's double
+// precision RGBtoHSV and Albers' float HSVtoRGB. Every 8 bit color is converted, and the keyer
+// must key exactly the colors it keyed before. usage: ./hsvcheck, exits 1 if a check fails
+
+#include "colorconv.h"
+#include "hsvref.h"
+#include "keyer.h"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//how far the float conversions may be from the old ones
+#define hueTolerance 2e-4
+#define fractionTolerance 1e-6
+
+//Albers' original conversion back to RGB
+static void HSVtoRGB(float h, float s, float v, unsigned char &r, unsigned char &g, unsigned char &b) {
+  float red, green, blue;
+  if (s == 0) {
+    red = green = blue = v;
+  }
+  else {
+    h /= 60.0;
+    int i = (int)floor(h);
+    float f = h - i;
+    float p = v * (1 - s), q = v * (1 - s * f), t = v * (1 - s * (1 - f));
+    switch (i) {
+      case 0: red = v; green = t; blue = p; break;
+      case 1: red = q; green = v; blue = p; break;
+      case 2: red = p; green = v; blue = t; break;
+      case 3: red = p; green = q; blue = v; break;
+      case 4: red = t; green = p; blue = v; break;
+      default: red = v; green = p; blue = q; break;
+    }
+  }
+  r = (unsigned char)(red * 255.0 + .5);
+  g = (unsigned char)(green * 255.0 + .5);
+  b = (unsigned char)(blue * 255.0 + .5);
+}
+
+//x / (2 * k) rounded to the nearest integer, halves up, as rgbToHsv8 promises
+static int roundedHalf(int x, int k) {
+  return (int)floor(x / (2.0 * k) + 0.5);
+}
+
+static int failures = 0;
+
+static void report(const char* check, long bad, double worst) {
+  cout << check << ": " << bad << " mismatches, worst " << worst << endl;
+  if (bad > 0)
+    failures++;
+}
+
+int main() {
+  const int width = 256 * 256;
+  vector<pixel> row(width);
+  vector<unsigned char> hsv8(3 * width);
+  vector<float> h(width), s(width), v(width), hsv(3 * width), scratch(3 * width);
+  long hueBad = 0, fractionBad = 0, batchBad = 0, byteBad = 0, keyBad = 0;
+  double hueWorst = 0, fractionWorst = 0;
+
+  //one red level at a time, every green and blue
+  for (int r = 0; r < 256; r++) {
+    for (int i = 0; i < width; i++) {
+      pixel p = { (unsigned char)r, (unsigned char)(i >> 8), (unsigned char)i, 255 };
+      row[i] = p;
+    }
+    rgbToHsvPixels(&row[0].red, 4, width, &h[0], &s[0], &v[0]);
+    rgbToHsvInterleaved(&row[0].red, 4, width, &hsv[0]);
+    rgbToHsv8(&row[0].red, 4, width, &hsv8[0]);
+
+    for (int i = 0; i < width; i++) {
+      int g = i >> 8, b = i & 255;
+      double HSV[3];
+      RGBtoHSV(r, g, b, HSV);
+
+      float h1, s1, v1;
+      rgbToHsv(r, g, b, h1, s1, v1);
+      double hueError = fabs(h1 - HSV[0]);
+      hueError = fmin(hueError, 360 - hueError);
+      hueWorst = fmax(hueWorst, hueError);
+      hueBad += hueError > hueTolerance;
+      double fractionError = fmax(fabs(s1 - HSV[1]), fabs(v1 - HSV[2]));
+      fractionWorst = fmax(fractionWorst, fractionError);
+      fractionBad += fractionError > fractionTolerance;
+
+      //the batch paths agree with the single pixel one exactly
+      batchBad += h[i] != h1 || s[i] != s1 || v[i] != v1 ||
+                  hsv[3 * i] != h1 || hsv[3 * i + 1] != s1 || hsv[3 * i + 2] != v1;
+
+      //8 bit HSV against the rounded exact fractions
+      int maxc = max(r, max(g, b)), delta = maxc - min(r, min(g, b));
+      int h8 = 0, s8 = 0;
+      if (delta > 0) {
+        int num = maxc == r ? g - b : (maxc == g ? b - r : r - g);
+        int offset = maxc == r ? 0 : (maxc == g ? 2 : 4);
+        int wrap = num < 0 && offset == 0 ? 360 : 0;
+        h8 = roundedHalf(60 * num + delta * (60 * offset + wrap), delta) % 180;
+        s8 = roundedHalf(510 * delta, maxc);
+      }
+      byteBad += hsv8[3 * i] != h8 || hsv8[3 * i + 1] != s8 || hsv8[3 * i + 2] != maxc;
+    }
+
+    maskRow(&row[0], width, &scratch[0], &scratch[width], &scratch[2 * width]);
+    for (int i = 0; i < width; i++) {
+      double HSV[3];
+      RGBtoHSV(r, i >> 8, i & 255, HSV);
+      keyBad += (row[i].alpha == 0) != isKeyColor(HSV[0], HSV[1], HSV[2]);
+    }
+  }
+  report("rgbToHsv hue against RGBtoHSV (degrees)", hueBad, hueWorst);
+  report("rgbToHsv saturation and value against RGBtoHSV", fractionBad, fractionWorst);
+  report("batch conversions against rgbToHsv", batchBad, 0);
+  report("rgbToHsv8 against exact rounding", byteBad, 0);
+  report("keyed colors against the double precision keyer", keyBad, 0);
+
+  //back to RGB over a grid of hues, saturations and values, single and planar
+  const int hues = 3600, steps = 21;
+  vector<float> H, S, V, R(hues * steps * steps), G(R.size()), B(R.size());
+  for (int i = 0; i < hues; i++) {
+    for (int j = 0; j < steps; j++) {
+      for (int k = 0; k < steps; k++) {
+        H.push_back(i * 0.1f);
+        S.push_back(j / (steps - 1.0f));
+        V.push_back(k / (steps - 1.0f));
+      }
+    }
+  }
+  hsvToRgbPlanar(&H[0], &S[0], &V[0], H.size(), &R[0], &G[0], &B[0]);
+  long rgbBad = 0;
+  int rgbWorst = 0;
+  for (size_t i = 0; i < H.size(); i++) {
+    unsigned char r0, g0, b0, r1, g1, b1;
+    HSVtoRGB(H[i], S[i], V[i], r0, g0, b0);
+    hsvToRgb(H[i], S[i], V[i], r1, g1, b1);
+    int r2 = (int)(R[i] * 255.0f + 0.5f), g2 = (int)(G[i] * 255.0f + 0.5f), b2 = (int)(B[i] * 255.0f + 0.5f);
+    int worst = max(abs(r0 - r1), max(abs(g0 - g1), abs(b0 - b1)));
+    worst = max(worst, max(abs(r2 - r1), max(abs(g2 - g1), abs(b2 - b1))));
+    rgbWorst = max(rgbWorst, worst);
+    rgbBad += worst > 1;
+  }
+  report("hsvToRgb and hsvToRgbPlanar against HSVtoRGB (steps)", rgbBad, rgbWorst);
+
+  if (failures > 0) {
+    cout << failures << " checks failed" << endl;
+    return 1;
+  }
+  cout << "all checks passed" << endl;
+  return 0;
+}
@@ -0,0 +1,33 @@
+// hsvref.h
+// Ryan Painter CPSC 4040
+// The keyer's original double precision RGB to HSV conversion, kept as the reference the shared
+// float conversions are checked against.
+
+#ifndef _HSVREF_INCLUDED_
+#define _HSVREF_INCLUDED_
+
+#include <cmath>
+
+//converts 8 bit r, g, b to h (0 - 360), s and v (0 - 1) in ret, in double precision
+inline void RGBtoHSV(int r, int g, int b, double* ret) {
+  double red = r / 255.0, green = g / 255.0, blue = b / 255.0;
+  double max = fmax(fmax(red, green), blue), min = fmin(fmin(red, green), blue);
+  double delta = max - min;
+  double h = 0, s = max == 0 ? 0 : delta / max;
+  if (max != 0 && delta != 0) {
+    if (red == max)
+      h = (green - blue) / delta;
+    else if (green == max)
+      h = 2.0 + (blue - red) / delta;
+    else
+      h = 4.0 + (red - green) / delta;
+    h = h * 60.0;
+    if (h < 0)
+      h = h + 360.0;
+  }
+  ret[0] = h;
+  ret[1] = s;
+  ret[2] = max;
+}
+
+#endif
@@ -0,0 +1,194 @@
+// Ryan Painter CPSC 4040
+// This program chromakeys image A and composites it over image B in a single pass,
+// without writing and re-reading an intermediate masked image.
+#include "keyer.h"
+#include "matte.h"
+#include "parallel.h"
+
+#include <OpenImageIO/imageio.h>
+#include <iostream>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+struct pixel** pixmapA;
+unsigned int widthA;
+unsigned int heightA;
+
+struct pixel** pixmapB;
+unsigned int widthB;
+unsigned int heightB;
+
+//read from an image file into a newly allocated pixmap with red, green, blue, and alpha channels
+bool readImage(string fileName, pixel** &pixmap, unsigned int &width, unsigned int &height) {
+
+  //code from https://openimageio.readthedocs.io/en/release-2.1.20.0/imageinput.html
+  auto in = ImageInput::open (fileName);
+  if (! in) {
+    cerr << "Could not open " << fileName << ", error = " << geterror() << endl;
+    return false;
+  }
+  const ImageSpec &spec = in->spec();
+  width = spec.width;
+  height = spec.height;
+  int channels = spec.nchannels;
+  vector<unsigned char> pixels (width*height*channels);
+  in->read_image (TypeDesc::UINT8, &pixels[0]);
+  in->close ();
+
+  //allocation for pixmap
+  pixmap = new pixel * [height];
+  pixmap[0] = new pixel[width * height];
+
+  for (int i = 1; i < height; i++) {
+    pixmap[i] = pixmap[i-1] + width;
+  }
+
+  //iterates through the pixmap and pixels vector copying all color values into their corresponding pixel in pixmap
+  int i = 0;
+  for (int r = 0; r < height; r++) {
+    for (int c = 0; c < width; c++) {
+      pixmap[r][c].red = pixels[i++];
+
+      //if image is greyscale, copy red value into blue and green to maintain color
+      if(channels == 1) {
+        pixmap[r][c].green = pixmap[r][c].red;
+        pixmap[r][c].blue = pixmap[r][c].red;
+      }
+      //else read the green and blue channels
+      else {
+        pixmap[r][c].green = pixels[i++];
+        pixmap[r][c].blue = pixels[i++];
+      }
+
+      //if image has alpha channel read it
+      if(channels == 4) {
+        pixmap[r][c].alpha = pixels[i++];
+      }
+      //else set to max oppacity
+      else {
+        pixmap[r][c].alpha = 255;
+      }
+    }
+  }
+
+  return true;
+}
+
+//writes the top left width x height corner of pixmap to a file. rowLength is the number of pixels
+//between the starts of two rows in pixmap, so a larger pixmap can be written without copying it
+void writeImage(string outfilename, pixel** pixmap, unsigned int width, unsigned int height, unsigned int rowLength){
+
+  // create the oiio file handler for the image
+  std::unique_ptr<ImageOutput> outfile = ImageOutput::create(outfilename);
+  if(!outfile){
+    cerr << "Could not create output image for " << outfilename << ", error = " << geterror() << endl;
+    return;
+  }
+
+  // open a file for writing the image. The file header will indicate an image of
+  // width w, height h, and 4 channels per pixel (RGBA). All channels will be of
+  // type unsigned char
+  ImageSpec spec(width, height, 4, TypeDesc::UINT8);
+  if(!outfile->open(outfilename, spec)){
+    cerr << "Could not open " << outfilename << ", error = " << geterror() << endl;
+    return;
+  }
+
+  // write the image straight from the pixmap, stepping rowLength pixels per scanline
+  if(!outfile->write_image(TypeDesc::UINT8, pixmap[0], sizeof(pixel), rowLength * sizeof(pixel))){
+    cerr << "Could not write image to " << outfilename << ", error = " << geterror() << endl;
+    return;
+  }
+  else
+    cout << "File saved" << endl;
+
+  // close the image file after the image is written
+  if(!outfile->close()){
+    cerr << "Could not close " << outfilename << ", error = " << geterror() << endl;
+    return;
+  }
+}
+
+//keys image A and composites it over image B, storing the result into the top left corner of pixmapB.
+//the alpha of keyed pixels in pixmapA is set to 0 so the matte can still be written afterwards.
+//if key is false the alpha of pixmapA is used as it is
+void keyAndCompose(bool key) {
+  parallelRows(heightA, [=](int rowBegin, int rowEnd) {
+    double rA, gA, bA, aA, rB, gB, bB, aB;
+    vector<float> h(widthA), s(widthA), v(widthA);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      //key out the row while it is still in the cache
+      if(key)
+        maskRow(pixmapA[r], widthA, &h[0], &s[0], &v[0]);
+
+      for (int c = 0; c < widthA; c++) {
+        pixel &A = pixmapA[r][c];
+        pixel &B = pixmapB[r][c];
+
+        //convert to premultiplied
+        aA = A.alpha / 255.0;
+        rA = A.red * aA;
+        gA = A.green * aA;
+        bA = A.blue * aA;
+        aB = B.alpha / 255.0;
+        rB = B.red * aB;
+        gB = B.green * aB;
+        bB = B.blue * aB;
+
+        //A over B formula
+        B.red = (rA + (1 - aA) * rB);
+        B.green = (gA + (1 - aA) * gB);
+        B.blue = (bA + (1 - aA) * bB);
+        B.alpha = (aA + (1 - aA) * aB) * 255;
+      }
+    }
+  });
+}
+
+int main(int argc, char* argv[]) {
+  //an optional matte filename, then a list of matte refinements
+  int first = 4;
+  if(argc > 4 && argv[4][0] != '-') {
+    first = 5;
+  }
+
+  vector<MatteOp> ops;
+  string rleFile;
+  if(argc < 4 || !parseMatteOps(argc, argv, first, ops, rleFile)) {
+    cerr << "incorrect usage. correct usage is: \"./keycomp <image A> <image B> <output> [matte] [-e radius] [-d radius] [-f radius] [-m matte.rle] ...\"" << endl;
+    return -1;
+  }
+
+  if(!readImage(argv[1], pixmapA, widthA, heightA) || !readImage(argv[2], pixmapB, widthB, heightB)) {
+    return -1;
+  }
+
+  if(heightA > heightB || widthA > widthB) {
+    //image B must be at least as big as image A
+    cerr << "Image B must be larger than Image A" << endl;
+    return -1;
+  }
+
+  //refinement needs the whole matte before compositing, otherwise key and composite in one pass
+  if(ops.empty()) {
+    keyAndCompose(true);
+  }
+  else {
+    mask(pixmapA, widthA, heightA);
+    refineMatte(pixmapA, widthA, heightA, ops);
+    keyAndCompose(false);
+  }
+  writeImage(argv[3], pixmapB, widthA, heightA, widthB);
+
+  //the keyed image A is the same matte alphamask would have written
+  if(first == 5) {
+    writeImage(argv[4], pixmapA, widthA, heightA, widthA);
+  }
+
+  if(rleFile != "") {
+    saveMatte(rleFile, pixmapA, widthA, heightA);
+  }
+
+  return 0;
+}
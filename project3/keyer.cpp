@@ -0,0 +1,69 @@
+// keyer.cpp
+// Ryan Painter CPSC 4040
+// Chromakey classification shared by alphamask and keycomp.
+
+#include "keyer.h"
+#include "colorconv.h"
+#include "hsvref.h"
+#include "parallel.h"
+
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+//these values determine the color to be masked
+#define targetHue 120
+#define hueVariance 55
+
+#define targetSaturation 1
+#define saturationVariance 0.65
+
+#define targetValue 1
+#define valueVariance 0.85
+
+//the float conversion puts hues within 2e-4 degrees, and saturations and values within 1e-6, of
+//the double precision ones the keyer was written against. colors closer than this to a bound are
+//decided in double precision, so a color exactly on a bound is keyed as it always was
+#define hueTie 1e-3
+#define fractionTie 1e-5
+
+static bool near(double x, double bound, double tie) {
+  return fabs(x - bound) < tie;
+}
+
+bool isKeyColor(double h, double s, double v) {
+  //check to see if the color near the color we want to mask
+  return h < targetHue + hueVariance && h > targetHue - hueVariance &&
+         s < targetSaturation + saturationVariance && s > targetSaturation - saturationVariance &&
+         v < targetValue + valueVariance && v > targetValue - valueVariance;
+}
+
+void maskRow(pixel* row, int width, float* h, float* s, float* v) {
+  //convert the whole row to HSV at once, then set the alpha to 0 for every pixel we want to mask
+  rgbToHsvPixels(&row[0].red, 4, width, h, s, v);
+  for (int c = 0; c < width; c++) {
+    bool key;
+    if (near(h[c], targetHue + hueVariance, hueTie) || near(h[c], targetHue - hueVariance, hueTie) ||
+        near(s[c], targetSaturation - saturationVariance, fractionTie) ||
+        near(v[c], targetValue - valueVariance, fractionTie)) {
+      double HSV[3];
+      RGBtoHSV(row[c].red, row[c].green, row[c].blue, HSV);
+      key = isKeyColor(HSV[0], HSV[1], HSV[2]);
+    }
+    else {
+      key = isKeyColor(h[c], s[c], v[c]);
+    }
+    if(key)
+      row[c].alpha = 0;
+  }
+}
+
+void mask(pixel** pixmap, int width, int height) {
+  parallelRows(height, [=](int rowBegin, int rowEnd) {
+    vector<float> h(width), s(width), v(width);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      maskRow(pixmap[r], width, &h[0], &s[0], &v[0]);
+    }
+  });
+}
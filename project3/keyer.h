@@ -0,0 +1,27 @@
+// keyer.h
+// Ryan Painter CPSC 4040
+// Chromakey classification shared by alphamask and keycomp.
+
+#ifndef _KEYER_INCLUDED_
+#define _KEYER_INCLUDED_
+
+//struct that stores the red, green, blue, and alpha channel of a pixel
+struct pixel {
+  unsigned char red;
+  unsigned char green;
+  unsigned char blue;
+  unsigned char alpha;
+};
+
+//true if an HSV color (h on scale 0 - 360, s and v on scale 0 - 1) is close enough to the
+//target color to be keyed out
+bool isKeyColor(double h, double s, double v);
+
+//sets the alpha of the keyed pixels of a row to 0, deciding exactly as the double precision
+//conversion would. h, s and v are scratch space of width floats
+void maskRow(pixel* row, int width, float* h, float* s, float* v);
+
+//sets the alpha of every pixel close to the target color to 0, split across threads by rows
+void mask(pixel** pixmap, int width, int height);
+
+#endif
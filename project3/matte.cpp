@@ -0,0 +1,391 @@
+// matte.cpp
+// Ryan Painter CPSC 4040
+// Post-processing of keyed mattes: erosion, dilation and feathering of a one byte per pixel alpha plane.
+
+#include "matte.h"
+#include "parallel.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+void getMatte(pixel** pixmap, int width, int height, unsigned char* matte) {
+  parallelRows(height, [=](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      for (int c = 0; c < width; c++) {
+        matte[(size_t)r * width + c] = pixmap[r][c].alpha;
+      }
+    }
+  });
+}
+
+void setMatte(pixel** pixmap, int width, int height, const unsigned char* matte) {
+  parallelRows(height, [=](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      for (int c = 0; c < width; c++) {
+        pixmap[r][c].alpha = matte[(size_t)r * width + c];
+      }
+    }
+  });
+}
+
+//the two operations the morphology filters are built from. neutral is the value that never changes
+//the result, used for the padding outside the image
+struct MinOp {
+  static const unsigned char neutral = 255;
+  unsigned char operator()(unsigned char a, unsigned char b) const { return a < b ? a : b; }
+};
+
+struct MaxOp {
+  static const unsigned char neutral = 0;
+  unsigned char operator()(unsigned char a, unsigned char b) const { return a > b ? a : b; }
+};
+
+/*
+  van Herk/Gil-Werman min or max filter of window k = 2 * radius + 1.
+  The padded line is cut into blocks of k. g holds the running op from the start of each block and
+  h the running op from the end of each block, so any window of k, which spans at most two blocks,
+  is op(h[x], g[x + k - 1]). That is three comparisons per pixel whatever the radius.
+*/
+template <typename Op>
+void filterRows(unsigned char* matte, int width, int height, int radius) {
+  int k = 2 * radius + 1;
+  int n = (width + 2 * radius + k - 1) / k * k;
+
+  parallelRows(height, [=](int rowBegin, int rowEnd) {
+    Op op;
+    vector<unsigned char> p(n, (unsigned char)Op::neutral), g(n), h(n);
+
+    for (int r = rowBegin; r < rowEnd; r++) {
+      unsigned char* row = matte + (size_t)r * width;
+      memcpy(&p[radius], row, width);
+
+      for (int b = 0; b < n; b += k) {
+        g[b] = p[b];
+        for (int i = b + 1; i < b + k; i++)
+          g[i] = op(g[i - 1], p[i]);
+        h[b + k - 1] = p[b + k - 1];
+        for (int i = b + k - 2; i >= b; i--)
+          h[i] = op(h[i + 1], p[i]);
+      }
+
+      for (int c = 0; c < width; c++)
+        row[c] = op(h[c], g[c + k - 1]);
+    }
+  });
+}
+
+//the same filter down the columns. each thread takes a band of columns and runs the recurrence on
+//whole row segments, so memory is still read a row at a time and the inner loops vectorize
+template <typename Op>
+void filterColumns(unsigned char* matte, int width, int height, int radius) {
+  int k = 2 * radius + 1;
+  int n = (height + 2 * radius + k - 1) / k * k;
+
+  parallelRows(width, [=](int colBegin, int colEnd) {
+    Op op;
+    int bw = colEnd - colBegin;
+    vector<unsigned char> g((size_t)n * bw), h((size_t)n * bw), pad(bw, (unsigned char)Op::neutral);
+
+    //row i of the padded band
+    auto p = [&](int i) -> const unsigned char* {
+      if(i < radius || i - radius >= height)
+        return &pad[0];
+      return matte + (size_t)(i - radius) * width + colBegin;
+    };
+
+    for (int b = 0; b < n; b += k) {
+      memcpy(&g[(size_t)b * bw], p(b), bw);
+      for (int i = b + 1; i < b + k; i++) {
+        const unsigned char* src = p(i);
+        unsigned char* prev = &g[(size_t)(i - 1) * bw];
+        unsigned char* cur = &g[(size_t)i * bw];
+        for (int c = 0; c < bw; c++)
+          cur[c] = op(prev[c], src[c]);
+      }
+
+      memcpy(&h[(size_t)(b + k - 1) * bw], p(b + k - 1), bw);
+      for (int i = b + k - 2; i >= b; i--) {
+        const unsigned char* src = p(i);
+        unsigned char* next = &h[(size_t)(i + 1) * bw];
+        unsigned char* cur = &h[(size_t)i * bw];
+        for (int c = 0; c < bw; c++)
+          cur[c] = op(next[c], src[c]);
+      }
+    }
+
+    for (int r = 0; r < height; r++) {
+      unsigned char* out = matte + (size_t)r * width + colBegin;
+      const unsigned char* hr = &h[(size_t)r * bw];
+      const unsigned char* gr = &g[(size_t)(r + k - 1) * bw];
+      for (int c = 0; c < bw; c++)
+        out[c] = op(hr[c], gr[c]);
+    }
+  });
+}
+
+void erode(unsigned char* matte, int width, int height, int radius) {
+  if(radius <= 0)
+    return;
+  filterRows<MinOp>(matte, width, height, radius);
+  filterColumns<MinOp>(matte, width, height, radius);
+}
+
+void dilate(unsigned char* matte, int width, int height, int radius) {
+  if(radius <= 0)
+    return;
+  filterRows<MaxOp>(matte, width, height, radius);
+  filterColumns<MaxOp>(matte, width, height, radius);
+}
+
+//clamps i to [0, n) so box filters repeat the edge pixels
+static inline int clampIndex(int i, int n) {
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+//box filter along each row with a running sum, so the cost does not depend on the radius
+static void boxRows(unsigned char* matte, int width, int height, int radius) {
+  int k = 2 * radius + 1;
+
+  parallelRows(height, [=](int rowBegin, int rowEnd) {
+    vector<unsigned char> src(width);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      unsigned char* row = matte + (size_t)r * width;
+      memcpy(&src[0], row, width);
+
+      int sum = 0;
+      for (int i = -radius; i <= radius; i++)
+        sum += src[clampIndex(i, width)];
+
+      for (int c = 0; c < width; c++) {
+        row[c] = (sum + k / 2) / k;
+        sum += src[clampIndex(c + radius + 1, width)] - src[clampIndex(c - radius, width)];
+      }
+    }
+  });
+}
+
+//box filter down the columns, keeping one running sum per column of the band
+static void boxColumns(unsigned char* matte, int width, int height, int radius) {
+  int k = 2 * radius + 1;
+  vector<unsigned char> copy(matte, matte + (size_t)width * height);
+  const unsigned char* src = &copy[0];
+
+  parallelRows(width, [=](int colBegin, int colEnd) {
+    int bw = colEnd - colBegin;
+    vector<int> sum(bw, 0);
+
+    auto row = [=](int r) { return src + (size_t)clampIndex(r, height) * width + colBegin; };
+
+    for (int i = -radius; i <= radius; i++) {
+      const unsigned char* s = row(i);
+      for (int c = 0; c < bw; c++)
+        sum[c] += s[c];
+    }
+
+    for (int r = 0; r < height; r++) {
+      unsigned char* out = matte + (size_t)r * width + colBegin;
+      const unsigned char* add = row(r + radius + 1);
+      const unsigned char* sub = row(r - radius);
+      for (int c = 0; c < bw; c++) {
+        out[c] = (sum[c] + k / 2) / k;
+        sum[c] += add[c] - sub[c];
+      }
+    }
+  });
+}
+
+void feather(unsigned char* matte, int width, int height, int radius) {
+  if(radius <= 0)
+    return;
+
+  //two box passes give a tent shaped falloff instead of a linear ramp with hard corners
+  for (int pass = 0; pass < 2; pass++) {
+    boxRows(matte, width, height, radius);
+    boxColumns(matte, width, height, radius);
+  }
+}
+
+bool parseMatteOps(int argc, char* argv[], int first, vector<MatteOp> &ops, string &rleFile) {
+  for (int i = first; i < argc; i += 2) {
+    string flag = argv[i];
+    if(i + 1 < argc && flag == "-m") {
+      rleFile = argv[i + 1];
+      continue;
+    }
+    if(i + 1 >= argc || (flag != "-e" && flag != "-d" && flag != "-f"))
+      return false;
+
+    MatteOp op;
+    op.op = flag[1];
+    op.radius = atoi(argv[i + 1]);
+    ops.push_back(op);
+  }
+  return true;
+}
+
+void refineMatte(pixel** pixmap, int width, int height, const vector<MatteOp> &ops) {
+  if(ops.empty())
+    return;
+
+  vector<unsigned char> matte((size_t)width * height);
+  getMatte(pixmap, width, height, &matte[0]);
+
+  for (const MatteOp &op : ops) {
+    switch(op.op) {
+      case 'e':
+        erode(&matte[0], width, height, op.radius);
+        break;
+      case 'd':
+        dilate(&matte[0], width, height, op.radius);
+        break;
+      case 'f':
+        feather(&matte[0], width, height, op.radius);
+        break;
+    }
+  }
+
+  setMatte(pixmap, width, height, &matte[0]);
+}
+
+void encodeMatte(const unsigned char* matte, int width, int height, RLEMatte &rle) {
+  rle.width = width;
+  rle.height = height;
+  rle.runs.clear();
+  rle.rows.assign(1, 0);
+
+  for (int r = 0; r < height; r++) {
+    const unsigned char* row = matte + (size_t)r * width;
+    int c = 0;
+    while(c < width) {
+      MatteRun run;
+      run.alpha = row[c];
+      run.length = 1;
+      while(c + (int)run.length < width && row[c + run.length] == run.alpha)
+        run.length++;
+      rle.runs.push_back(run);
+      c += run.length;
+    }
+    rle.rows.push_back(rle.runs.size());
+  }
+}
+
+static void writeVarint(ofstream &out, unsigned int value) {
+  while(value >= 0x80) {
+    out.put((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.put((char)value);
+}
+
+static bool readVarint(ifstream &in, unsigned int &value) {
+  value = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    int byte = in.get();
+    if(byte == EOF)
+      return false;
+    value |= (unsigned int)(byte & 0x7f) << shift;
+    if(!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool writeMatteRLE(string filename, const RLEMatte &rle) {
+  ofstream out(filename, ios::binary);
+  if(!out) {
+    cerr << "Could not open " << filename << " for writing" << endl;
+    return false;
+  }
+
+  out.write("RLEM", 4);
+  writeVarint(out, rle.width);
+  writeVarint(out, rle.height);
+  for (int r = 0; r < rle.height; r++) {
+    writeVarint(out, rle.rows[r + 1] - rle.rows[r]);
+    for (unsigned int i = rle.rows[r]; i < rle.rows[r + 1]; i++) {
+      out.put((char)rle.runs[i].alpha);
+      writeVarint(out, rle.runs[i].length);
+    }
+  }
+
+  if(!out) {
+    cerr << "Could not write matte to " << filename << endl;
+    return false;
+  }
+  return true;
+}
+
+bool readMatteRLE(string filename, RLEMatte &rle) {
+  ifstream in(filename, ios::binary);
+  char magic[4];
+  if(!in || !in.read(magic, 4) || memcmp(magic, "RLEM", 4) != 0) {
+    cerr << filename << " is not a run-length matte" << endl;
+    return false;
+  }
+
+  unsigned int width, height;
+  if(!readVarint(in, width) || !readVarint(in, height)) {
+    cerr << "Could not read matte header from " << filename << endl;
+    return false;
+  }
+  if(width > INT_MAX || height > INT_MAX) {
+    cerr << "Matte " << filename << " is too large" << endl;
+    return false;
+  }
+  rle.width = width;
+  rle.height = height;
+  rle.runs.clear();
+  rle.rows.assign(1, 0);
+
+  for (int r = 0; r < rle.height; r++) {
+    unsigned int count;
+    unsigned long long covered = 0;
+    if(!readVarint(in, count)) {
+      cerr << "Matte " << filename << " is truncated" << endl;
+      return false;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+      MatteRun run;
+      int alpha = in.get();
+      if(alpha == EOF || !readVarint(in, run.length)) {
+        cerr << "Matte " << filename << " is truncated" << endl;
+        return false;
+      }
+      //a run past the end of the row would be copied past the end of it when composing
+      if(run.length > width - covered) {
+        cerr << "Matte " << filename << " has a row of the wrong length" << endl;
+        return false;
+      }
+      run.alpha = alpha;
+      covered += run.length;
+      rle.runs.push_back(run);
+    }
+    //every row must cover the width exactly so decoding can trust the runs
+    if(covered != width) {
+      cerr << "Matte " << filename << " has a row of the wrong length" << endl;
+      return false;
+    }
+    rle.rows.push_back(rle.runs.size());
+  }
+
+  return true;
+}
+
+bool saveMatte(string filename, pixel** pixmap, int width, int height) {
+  vector<unsigned char> matte((size_t)width * height);
+  getMatte(pixmap, width, height, &matte[0]);
+
+  RLEMatte rle;
+  encodeMatte(&matte[0], width, height, rle);
+  if(!writeMatteRLE(filename, rle))
+    return false;
+
+  cout << "Matte saved (" << rle.runs.size() << " runs)" << endl;
+  return true;
+}
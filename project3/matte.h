@@ -0,0 +1,63 @@
+// matte.h
+// Ryan Painter CPSC 4040
+// Post-processing of keyed mattes. Mattes are stored as a plane of one unsigned char alpha per pixel,
+// row after row, so the filters never touch the color channels.
+
+#ifndef _MATTE_INCLUDED_
+#define _MATTE_INCLUDED_
+
+#include "keyer.h"
+
+#include <string>
+#include <vector>
+
+//a single refinement step: 'e' erode, 'd' dilate or 'f' feather, by radius pixels
+struct MatteOp {
+  char op;
+  int radius;
+};
+
+//copy the alpha channel of pixmap into matte, and back
+void getMatte(pixel** pixmap, int width, int height, unsigned char* matte);
+void setMatte(pixel** pixmap, int width, int height, const unsigned char* matte);
+
+//min and max filters over a (2 * radius + 1) square, treating pixels outside the image as neutral
+void erode(unsigned char* matte, int width, int height, int radius);
+void dilate(unsigned char* matte, int width, int height, int radius);
+
+//softens matte edges with two passes of a (2 * radius + 1) box filter in each direction
+void feather(unsigned char* matte, int width, int height, int radius);
+
+//reads "-e r", "-d r" and "-f r" pairs from argv[first] onward, and "-m file" as the name of a run-length
+//encoded matte to save. returns false on an unknown option
+bool parseMatteOps(int argc, char* argv[], int first, std::vector<MatteOp> &ops, std::string &rleFile);
+
+//applies each op to the alpha channel of pixmap in order
+void refineMatte(pixel** pixmap, int width, int height, const std::vector<MatteOp> &ops);
+
+//one run of equal alpha along a row of a run-length encoded matte
+struct MatteRun {
+  unsigned int length;
+  unsigned char alpha;
+};
+
+//a matte stored as runs of equal alpha. the runs of row r are runs[rows[r]] up to runs[rows[r + 1]].
+//a hard matte needs only a few runs per row, where the RGBA image it came from needs 4 bytes per pixel
+struct RLEMatte {
+  int width;
+  int height;
+  std::vector<MatteRun> runs;
+  std::vector<unsigned int> rows;
+};
+
+void encodeMatte(const unsigned char* matte, int width, int height, RLEMatte &rle);
+
+//run-length matte files hold "RLEM", the width and height, then for each row the number of runs
+//followed by each run as an alpha byte and a length, counts and lengths stored as base 128 varints
+bool writeMatteRLE(std::string filename, const RLEMatte &rle);
+bool readMatteRLE(std::string filename, RLEMatte &rle);
+
+//encodes the alpha channel of pixmap and writes it as a run-length matte file
+bool saveMatte(std::string filename, pixel** pixmap, int width, int height);
+
+#endif
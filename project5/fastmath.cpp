@@ -0,0 +1,210 @@
+// fastmath.cpp
+// Ryan Painter CPSC 4040
+// Approximate power, log2 and exp2 for tone curves, vectorized with AVX2 or SSE2 when available.
+
+#include "fastmath.h"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+//log2(m) = 2 / ln(2) * (t + t^3 / 3 + t^5 / 5 + t^7 / 7 + ...), |t| <= 0.172 after range reduction
+#define LOG_C1 2.88539008f
+#define LOG_C3 0.961796694f
+#define LOG_C5 0.577078016f
+#define LOG_C7 0.412198583f
+
+//2^f = sum of (f ln(2))^i / i!, |f| <= 0.5
+#define EXP_C1 0.693147181f
+#define EXP_C2 0.240226507f
+#define EXP_C3 0.0555041087f
+#define EXP_C4 0.00961812911f
+#define EXP_C5 0.00133335581f
+#define EXP_C6 0.000154035304f
+
+#define SQRT2 1.41421356f
+
+//exp2 inputs are clamped so the result and its exponent stay normal floats
+#define EXP_MIN -125.0f
+#define EXP_MAX 127.0f
+
+static inline int bitsOf(float x) {
+  int i;
+  memcpy(&i, &x, sizeof(i));
+  return i;
+}
+
+static inline float floatOf(int i) {
+  float x;
+  memcpy(&x, &i, sizeof(x));
+  return x;
+}
+
+//log2 of a positive normal float
+static inline float log2Scalar(float x) {
+  int bits = bitsOf(x);
+  int e = ((bits >> 23) & 255) - 127;
+  float m = floatOf((bits & 0x7fffff) | 0x3f800000);
+  if(m > SQRT2) {
+    m *= 0.5f;
+    e += 1;
+  }
+  float t = (m - 1) / (m + 1);
+  float t2 = t * t;
+  return e + t * (LOG_C1 + t2 * (LOG_C3 + t2 * (LOG_C5 + t2 * LOG_C7)));
+}
+
+static inline float exp2Scalar(float y) {
+  y = y < EXP_MIN ? EXP_MIN : (y > EXP_MAX ? EXP_MAX : y);
+  int k = (int)lrintf(y);
+  float f = y - k;
+  float poly = 1 + f * (EXP_C1 + f * (EXP_C2 + f * (EXP_C3 + f * (EXP_C4 + f * (EXP_C5 + f * EXP_C6)))));
+  //k is negative for results below 1, so it is shifted unsigned
+  return floatOf((int)((unsigned int)bitsOf(poly) + ((unsigned int)k << 23)));
+}
+
+/*
+  The same steps on eight or four lanes. log2 takes the lanes as they are, so callers clamp them to
+  at least FLT_MIN first.
+*/
+#if defined(__AVX2__)
+typedef __m256 floats;
+#  define LANES 8
+
+static inline __m256 log2Lanes(__m256 X) {
+  __m256i bits = _mm256_castps_si256(X);
+  __m256i e = _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127));
+  __m256 m = _mm256_castsi256_ps(_mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x7fffff)), _mm256_set1_epi32(0x3f800000)));
+  __m256 big = _mm256_cmp_ps(m, _mm256_set1_ps(SQRT2), _CMP_GT_OQ);
+  m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), big);
+  e = _mm256_sub_epi32(e, _mm256_castps_si256(big));
+
+  const __m256 one = _mm256_set1_ps(1.0f);
+  __m256 t = _mm256_div_ps(_mm256_sub_ps(m, one), _mm256_add_ps(m, one));
+  __m256 t2 = _mm256_mul_ps(t, t);
+  __m256 s = _mm256_add_ps(_mm256_set1_ps(LOG_C5), _mm256_mul_ps(t2, _mm256_set1_ps(LOG_C7)));
+  s = _mm256_add_ps(_mm256_set1_ps(LOG_C3), _mm256_mul_ps(t2, s));
+  s = _mm256_add_ps(_mm256_set1_ps(LOG_C1), _mm256_mul_ps(t2, s));
+  return _mm256_add_ps(_mm256_cvtepi32_ps(e), _mm256_mul_ps(t, s));
+}
+
+static inline __m256 exp2Lanes(__m256 y) {
+  y = _mm256_min_ps(_mm256_max_ps(y, _mm256_set1_ps(EXP_MIN)), _mm256_set1_ps(EXP_MAX));
+  __m256i k = _mm256_cvtps_epi32(y);
+  __m256 f = _mm256_sub_ps(y, _mm256_cvtepi32_ps(k));
+
+  __m256 poly = _mm256_add_ps(_mm256_set1_ps(EXP_C5), _mm256_mul_ps(f, _mm256_set1_ps(EXP_C6)));
+  poly = _mm256_add_ps(_mm256_set1_ps(EXP_C4), _mm256_mul_ps(f, poly));
+  poly = _mm256_add_ps(_mm256_set1_ps(EXP_C3), _mm256_mul_ps(f, poly));
+  poly = _mm256_add_ps(_mm256_set1_ps(EXP_C2), _mm256_mul_ps(f, poly));
+  poly = _mm256_add_ps(_mm256_set1_ps(EXP_C1), _mm256_mul_ps(f, poly));
+  poly = _mm256_add_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(f, poly));
+  return _mm256_castsi256_ps(_mm256_add_epi32(_mm256_castps_si256(poly), _mm256_slli_epi32(k, 23)));
+}
+
+static inline __m256 loadLanes(const float* p) { return _mm256_loadu_ps(p); }
+static inline void storeLanes(float* p, __m256 v) { _mm256_storeu_ps(p, v); }
+static inline __m256 splat(float x) { return _mm256_set1_ps(x); }
+static inline __m256 mulLanes(__m256 a, __m256 b) { return _mm256_mul_ps(a, b); }
+static inline __m256 maxLanes(__m256 a, __m256 b) { return _mm256_max_ps(a, b); }
+//a where x > 0, else 0
+static inline __m256 positiveOnly(__m256 x, __m256 a) {
+  return _mm256_and_ps(_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_GT_OQ), a);
+}
+
+#elif defined(__SSE2__)
+typedef __m128 floats;
+#  define LANES 4
+
+static inline __m128 log2Lanes(__m128 X) {
+  __m128i bits = _mm_castps_si128(X);
+  __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127));
+  __m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)), _mm_set1_epi32(0x3f800000)));
+  __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(SQRT2));
+  m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))), _mm_andnot_ps(big, m));
+  e = _mm_sub_epi32(e, _mm_castps_si128(big));
+
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+  __m128 t2 = _mm_mul_ps(t, t);
+  __m128 s = _mm_add_ps(_mm_set1_ps(LOG_C5), _mm_mul_ps(t2, _mm_set1_ps(LOG_C7)));
+  s = _mm_add_ps(_mm_set1_ps(LOG_C3), _mm_mul_ps(t2, s));
+  s = _mm_add_ps(_mm_set1_ps(LOG_C1), _mm_mul_ps(t2, s));
+  return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(t, s));
+}
+
+static inline __m128 exp2Lanes(__m128 y) {
+  y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(EXP_MIN)), _mm_set1_ps(EXP_MAX));
+  __m128i k = _mm_cvtps_epi32(y);
+  __m128 f = _mm_sub_ps(y, _mm_cvtepi32_ps(k));
+
+  __m128 poly = _mm_add_ps(_mm_set1_ps(EXP_C5), _mm_mul_ps(f, _mm_set1_ps(EXP_C6)));
+  poly = _mm_add_ps(_mm_set1_ps(EXP_C4), _mm_mul_ps(f, poly));
+  poly = _mm_add_ps(_mm_set1_ps(EXP_C3), _mm_mul_ps(f, poly));
+  poly = _mm_add_ps(_mm_set1_ps(EXP_C2), _mm_mul_ps(f, poly));
+  poly = _mm_add_ps(_mm_set1_ps(EXP_C1), _mm_mul_ps(f, poly));
+  poly = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, poly));
+  return _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(poly), _mm_slli_epi32(k, 23)));
+}
+
+static inline __m128 loadLanes(const float* p) { return _mm_loadu_ps(p); }
+static inline void storeLanes(float* p, __m128 v) { _mm_storeu_ps(p, v); }
+static inline __m128 splat(float x) { return _mm_set1_ps(x); }
+static inline __m128 mulLanes(__m128 a, __m128 b) { return _mm_mul_ps(a, b); }
+static inline __m128 maxLanes(__m128 a, __m128 b) { return _mm_max_ps(a, b); }
+//a where x > 0, else 0
+static inline __m128 positiveOnly(__m128 x, __m128 a) {
+  return _mm_and_ps(_mm_cmpgt_ps(x, _mm_setzero_ps()), a);
+}
+#endif
+
+float fastPow(float x, float p) {
+  if(x <= 0)
+    return 0;
+  x = x < FLT_MIN ? FLT_MIN : x;
+  return exp2Scalar(p * log2Scalar(x));
+}
+
+void fastPowRow(const float* x, int n, float p, float* out) {
+  int i = 0;
+#ifdef LANES
+  floats power = splat(p);
+  floats smallest = splat(FLT_MIN);
+  for (; i + LANES <= n; i += LANES) {
+    floats X = loadLanes(x + i);
+    floats result = exp2Lanes(mulLanes(power, log2Lanes(maxLanes(X, smallest))));
+    storeLanes(out + i, positiveOnly(X, result));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = fastPow(x[i], p);
+}
+
+void fastLog2Row(const float* x, int n, float* out) {
+  int i = 0;
+#ifdef LANES
+  floats smallest = splat(FLT_MIN);
+  for (; i + LANES <= n; i += LANES) {
+    storeLanes(out + i, log2Lanes(maxLanes(loadLanes(x + i), smallest)));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = log2Scalar(x[i] < FLT_MIN ? FLT_MIN : x[i]);
+}
+
+void fastExp2Row(const float* y, int n, float* out) {
+  int i = 0;
+#ifdef LANES
+  for (; i + LANES <= n; i += LANES) {
+    storeLanes(out + i, exp2Lanes(loadLanes(y + i)));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = exp2Scalar(y[i]);
+}
@@ -0,0 +1,26 @@
+// fastmath.h
+// Ryan Painter CPSC 4040
+// Approximate power, log2 and exp2 for tone curves, vectorized with AVX2 or SSE2 when available.
+
+#ifndef _FASTMATH_INCLUDED_
+#define _FASTMATH_INCLUDED_
+
+/*
+  x^p computed as exp2(p * log2(x)). log2 splits off the exponent and evaluates a series in
+  t = (m - 1) / (m + 1) on the mantissa m in [sqrt(1/2), sqrt(2)), exp2 splits off the nearest integer
+  and evaluates a degree 6 polynomial on the rest. Over x in [1e-6, 1e6] and p in [-1, 1] the relative
+  error is below 2e-6, most of it from rounding p * log2(x) to a float. x <= 0 gives 0, denormal x
+  is treated as the smallest normal float, and results are clamped to [2^-125, 2^127].
+*/
+float fastPow(float x, float p);
+
+//out[i] = fastPow(x[i], p) for n values, eight at a time with AVX2 or four with SSE2.
+//x and out may be the same array
+void fastPowRow(const float* x, int n, float p, float* out);
+
+//the two halves of the power function on their own. log2 treats x below the smallest normal
+//float (including x <= 0) as that float, exp2 clamps y to [-125, 127]
+void fastLog2Row(const float* x, int n, float* out);
+void fastExp2Row(const float* y, int n, float* out);
+
+#endif
@@ -0,0 +1,367 @@
+// fuse.cpp
+// Ryan Painter CPSC 4040
+// Exposure fusion: blends bracketed LDR exposures straight into a displayable image.
+
+#include "fuse.h"
+#include "fastmath.h"
+#include "parallel.h"
+
+#include <OpenImageIO/imageio.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+//pyramids stop before either side of a level would drop below this
+#define MIN_LEVEL_SIZE 8
+
+//rows read from a bracket, or handed out of the result, at a time
+#define FUSE_STRIP 64
+
+//spread of the well exposed weight around 0.5
+#define EXPOSURE_SIGMA 0.2f
+
+//added to every weight, so pixels no bracket weighs are an even blend instead of a division by zero
+#define WEIGHT_EPSILON 1e-12f
+
+#define LOG2E 1.44269504f
+
+//one channel of an image, or of a pyramid level
+struct Plane {
+  int width, height;
+  vector<float> data;
+
+  float* row(int r) { return &data[(size_t)r * width]; }
+  const float* row(int r) const { return &data[(size_t)r * width]; }
+};
+
+//recycles the storage of planes. a plane given back is handed out again for the next one that fits,
+//so after the first bracket the pyramids of the rest are built without allocating
+struct PlaneArena {
+  vector<vector<float>> spare;
+
+  //a width x height plane. its values are left over from the last use, so callers overwrite them
+  Plane take(int width, int height) {
+    size_t n = (size_t)width * height;
+    int best = -1;
+    for (int i = 0; i < (int)spare.size(); i++) {
+      if(spare[i].capacity() >= n && (best < 0 || spare[i].capacity() < spare[best].capacity()))
+        best = i;
+    }
+
+    Plane plane;
+    plane.width = width;
+    plane.height = height;
+    if(best >= 0) {
+      plane.data = std::move(spare[best]);
+      spare.erase(spare.begin() + best);
+    }
+    plane.data.resize(n);
+    return plane;
+  }
+
+  void give(Plane &plane) {
+    spare.push_back(std::move(plane.data));
+    plane.data = vector<float>();
+  }
+};
+
+static inline int clampIndex(int i, int n) {
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+//reads a bracket into red, green and blue planes, a strip of rows at a time. a greyscale bracket
+//fills all three with its one channel, and color is set false
+static bool readBracket(const string &file, PlaneArena &arena, Plane rgb[3], bool &color) {
+  auto in = ImageInput::open(file);
+  if(!in) {
+    cerr << "Could not open " << file << ", error = " << geterror() << endl;
+    return false;
+  }
+  const ImageSpec &spec = in->spec();
+  int width = spec.width, height = spec.height;
+  int channels = spec.nchannels >= 3 ? 3 : 1;
+  color = channels == 3;
+  for (int c = 0; c < 3; c++) {
+    rgb[c] = arena.take(width, height);
+  }
+
+  vector<float> strip((size_t)width * FUSE_STRIP * channels);
+  for (int y = 0; y < height; y += FUSE_STRIP) {
+    int rows = min(FUSE_STRIP, height - y);
+    if(!in->read_scanlines(0, 0, spec.y + y, spec.y + y + rows, 0, 0, channels, TypeDesc::FLOAT, &strip[0])) {
+      cerr << "Could not read rows " << y << " to " << y + rows << " of " << file << ", error = " << in->geterror() << endl;
+      return false;
+    }
+    //brackets are display values, so float files are clipped to 0 - 1 the way an 8 bit one would be
+    size_t n = (size_t)width * rows;
+    for (int c = 0; c < 3; c++) {
+      float* dst = rgb[c].row(y);
+      const float* src = &strip[channels == 1 ? 0 : c];
+      for (size_t i = 0; i < n; i++) {
+        float v = src[i * channels];
+        dst[i] = v < 0 ? 0 : (v > 1 ? 1 : v);
+      }
+    }
+  }
+  return true;
+}
+
+//weight of every pixel of a bracket: contrast * saturation * well exposedness. greyscale brackets
+//have no saturation, so theirs is left out rather than zeroing every weight
+static Plane weighBracket(const Plane rgb[3], bool color, PlaneArena &arena) {
+  int width = rgb[0].width, height = rgb[0].height;
+  Plane grey = arena.take(width, height);
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      const float *red = rgb[0].row(r), *green = rgb[1].row(r), *blue = rgb[2].row(r);
+      float* dst = grey.row(r);
+      for (int x = 0; x < width; x++) {
+        dst[x] = (red[x] + green[x] + blue[x]) / 3;
+      }
+    }
+  });
+
+  Plane weight = arena.take(width, height);
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    vector<float> exponent(width), exposed(width);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      const float *red = rgb[0].row(r), *green = rgb[1].row(r), *blue = rgb[2].row(r);
+      const float *up = grey.row(clampIndex(r - 1, height)), *mid = grey.row(r), *down = grey.row(clampIndex(r + 1, height));
+      float* dst = weight.row(r);
+      for (int x = 0; x < width; x++) {
+        float left = mid[clampIndex(x - 1, width)], right = mid[clampIndex(x + 1, width)];
+        float contrast = fabsf(up[x] + down[x] + left + right - 4 * mid[x]);
+
+        float saturation = 1;
+        if(color) {
+          float mean = (red[x] + green[x] + blue[x]) / 3;
+          float dr = red[x] - mean, dg = green[x] - mean, db = blue[x] - mean;
+          saturation = sqrtf((dr * dr + dg * dg + db * db) / 3);
+        }
+
+        float er = red[x] - 0.5f, eg = green[x] - 0.5f, eb = blue[x] - 0.5f;
+        exponent[x] = -(er * er + eg * eg + eb * eb) / (2 * EXPOSURE_SIGMA * EXPOSURE_SIGMA) * LOG2E;
+        dst[x] = contrast * saturation;
+      }
+      fastExp2Row(&exponent[0], width, &exposed[0]);
+      for (int x = 0; x < width; x++) {
+        dst[x] = dst[x] * exposed[x] + WEIGHT_EPSILON;
+      }
+    }
+  });
+
+  arena.give(grey);
+  return weight;
+}
+
+//the 5 tap binomial kernel, about a gaussian, pyramid levels are blurred with
+static const float KERNEL[5] = {1 / 16.0f, 4 / 16.0f, 6 / 16.0f, 4 / 16.0f, 1 / 16.0f};
+
+//blurs in and keeps every other pixel of every other row, into out, half its size rounded up
+static void reduce(const Plane &in, Plane &out) {
+  parallelRows(out.height, [&](int rowBegin, int rowEnd) {
+    vector<float> column(in.width);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      const float* rows[5];
+      for (int k = 0; k < 5; k++) {
+        rows[k] = in.row(clampIndex(2 * r + k - 2, in.height));
+      }
+      for (int x = 0; x < in.width; x++) {
+        column[x] = KERNEL[0] * rows[0][x] + KERNEL[1] * rows[1][x] + KERNEL[2] * rows[2][x] +
+                    KERNEL[3] * rows[3][x] + KERNEL[4] * rows[4][x];
+      }
+
+      float* dst = out.row(r);
+      for (int x = 0; x < out.width; x++) {
+        float sum = 0;
+        for (int k = 0; k < 5; k++) {
+          sum += KERNEL[k] * column[clampIndex(2 * x + k - 2, in.width)];
+        }
+        dst[x] = sum;
+      }
+    }
+  });
+}
+
+//row r of small upsampled to width pixels, into out. even pixels sit on small's and odd ones fall
+//between two of them, which is inserting zeros and blurring with twice the kernel. column is
+//scratch space of small.width floats
+static void expandRow(const Plane &small, int r, int width, float* column, float* out) {
+  int half = r / 2;
+  const float* center = small.row(clampIndex(half, small.height));
+  const float* next = small.row(clampIndex(half + 1, small.height));
+  if(r % 2 == 0) {
+    const float* prev = small.row(clampIndex(half - 1, small.height));
+    for (int x = 0; x < small.width; x++)
+      column[x] = (prev[x] + 6 * center[x] + next[x]) / 8;
+  }
+  else {
+    for (int x = 0; x < small.width; x++)
+      column[x] = (center[x] + next[x]) / 2;
+  }
+
+  for (int x = 0; x < width; x++) {
+    int c = x / 2;
+    if(x % 2 == 0)
+      out[x] = (column[clampIndex(c - 1, small.width)] + 6 * column[c] + column[clampIndex(c + 1, small.width)]) / 8;
+    else
+      out[x] = (column[c] + column[clampIndex(c + 1, small.width)]) / 2;
+  }
+}
+
+bool fuseExposures(const vector<string> &files, int &width, int &height, function<void(int, int, const pixel*)> out) {
+  auto start = chrono::steady_clock::now();
+  PlaneArena arena;
+  Plane rgb[3];
+  bool color, firstColor = true;
+
+  //first pass: the sum of every bracket's weights, to normalize them with
+  Plane total;
+  for (size_t j = 0; j < files.size(); j++) {
+    if(!readBracket(files[j], arena, rgb, color))
+      return false;
+    if(j == 0) {
+      width = rgb[0].width;
+      height = rgb[0].height;
+      firstColor = color;
+      total = arena.take(width, height);
+      fill(total.data.begin(), total.data.end(), 0.0f);
+    }
+    else if(rgb[0].width != width || rgb[0].height != height) {
+      cerr << files[j] << " is not the size of " << files[0] << endl;
+      return false;
+    }
+    //weights with and without saturation are not comparable
+    else if(color != firstColor) {
+      cerr << files[j] << " and " << files[0] << " must both be color or both be greyscale" << endl;
+      return false;
+    }
+
+    Plane weight = weighBracket(rgb, color, arena);
+    parallelRows(height, [&](int rowBegin, int rowEnd) {
+      for (int r = rowBegin; r < rowEnd; r++) {
+        float *sum = total.row(r), *w = weight.row(r);
+        for (int x = 0; x < width; x++)
+          sum[x] += w[x];
+      }
+    });
+    arena.give(weight);
+    for (int c = 0; c < 3; c++)
+      arena.give(rgb[c]);
+  }
+
+  //level sizes, halving until a side would drop below MIN_LEVEL_SIZE
+  vector<int> levelWidth(1, width), levelHeight(1, height);
+  while((levelWidth.back() + 1) / 2 >= MIN_LEVEL_SIZE && (levelHeight.back() + 1) / 2 >= MIN_LEVEL_SIZE) {
+    levelWidth.push_back((levelWidth.back() + 1) / 2);
+    levelHeight.push_back((levelHeight.back() + 1) / 2);
+  }
+  int levels = levelWidth.size();
+
+  //the blended Laplacian pyramid of each channel
+  vector<Plane> result[3];
+  for (int c = 0; c < 3; c++) {
+    for (int i = 0; i < levels; i++) {
+      result[c].push_back(arena.take(levelWidth[i], levelHeight[i]));
+      fill(result[c][i].data.begin(), result[c][i].data.end(), 0.0f);
+    }
+  }
+
+  //second pass: adds each bracket's Laplacian pyramid, weighted by the gaussian pyramid of its
+  //normalized weights. a channel only has two of its levels in memory at once, and every plane
+  //goes back to the arena for the next level or bracket
+  for (size_t j = 0; j < files.size(); j++) {
+    if(!readBracket(files[j], arena, rgb, color))
+      return false;
+
+    vector<Plane> weights(levels);
+    weights[0] = weighBracket(rgb, color, arena);
+    parallelRows(height, [&](int rowBegin, int rowEnd) {
+      for (int r = rowBegin; r < rowEnd; r++) {
+        float *w = weights[0].row(r), *sum = total.row(r);
+        for (int x = 0; x < width; x++)
+          w[x] /= sum[x];
+      }
+    });
+    for (int i = 1; i < levels; i++) {
+      weights[i] = arena.take(levelWidth[i], levelHeight[i]);
+      reduce(weights[i - 1], weights[i]);
+    }
+
+    for (int c = 0; c < 3; c++) {
+      Plane level = std::move(rgb[c]);
+      for (int i = 0; i < levels; i++) {
+        Plane &blend = result[c][i];
+        Plane &weight = weights[i];
+
+        //the top level is the gaussian itself
+        if(i == levels - 1) {
+          for (size_t k = 0; k < level.data.size(); k++)
+            blend.data[k] += weight.data[k] * level.data[k];
+          arena.give(level);
+          break;
+        }
+
+        Plane smaller = arena.take(levelWidth[i + 1], levelHeight[i + 1]);
+        reduce(level, smaller);
+        parallelRows(level.height, [&](int rowBegin, int rowEnd) {
+          vector<float> column(smaller.width), expanded(level.width);
+          for (int r = rowBegin; r < rowEnd; r++) {
+            expandRow(smaller, r, level.width, &column[0], &expanded[0]);
+            const float *g = level.row(r), *w = weight.row(r);
+            float* dst = blend.row(r);
+            for (int x = 0; x < level.width; x++)
+              dst[x] += w[x] * (g[x] - expanded[x]);
+          }
+        });
+        arena.give(level);
+        level = std::move(smaller);
+      }
+    }
+
+    for (auto &weight : weights)
+      arena.give(weight);
+  }
+  arena.give(total);
+
+  //collapses each blended pyramid from the top down into its first level
+  for (int c = 0; c < 3; c++) {
+    for (int i = levels - 2; i >= 0; i--) {
+      Plane &level = result[c][i];
+      Plane &smaller = result[c][i + 1];
+      parallelRows(level.height, [&](int rowBegin, int rowEnd) {
+        vector<float> column(smaller.width), expanded(level.width);
+        for (int r = rowBegin; r < rowEnd; r++) {
+          expandRow(smaller, r, level.width, &column[0], &expanded[0]);
+          float* dst = level.row(r);
+          for (int x = 0; x < level.width; x++)
+            dst[x] += expanded[x];
+        }
+      });
+      arena.give(smaller);
+    }
+  }
+
+  cout << "fused " << files.size() << " brackets over " << levels << " pyramid levels in "
+       << chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() << " ms" << endl;
+
+  vector<pixel> strip((size_t)width * FUSE_STRIP);
+  for (int y = 0; y < height; y += FUSE_STRIP) {
+    int rows = min(FUSE_STRIP, height - y);
+    for (int r = 0; r < rows; r++) {
+      const float *red = result[0][0].row(y + r), *green = result[1][0].row(y + r), *blue = result[2][0].row(y + r);
+      pixel* dst = &strip[(size_t)r * width];
+      for (int x = 0; x < width; x++) {
+        dst[x].r = red[x];
+        dst[x].g = green[x];
+        dst[x].b = blue[x];
+        dst[x].a = 255;
+      }
+    }
+    out(y, rows, &strip[0]);
+  }
+  return true;
+}
@@ -0,0 +1,29 @@
+// fuse.h
+// Ryan Painter CPSC 4040
+// Exposure fusion: blends bracketed LDR exposures straight into a displayable image.
+
+#ifndef _FUSE_INCLUDED_
+#define _FUSE_INCLUDED_
+
+#include "operators.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+  Mertens, Kautz and Van Reeth 2007. Each bracket gets a weight per pixel, the product of its
+  contrast (the Laplacian of its grey), saturation (the deviation of its channels, left out when the
+  brackets are greyscale) and how well exposed it is (closeness to 0.5). The brackets are blended
+  with those weights level by level of their Laplacian pyramids, so the seams between them fall at
+  every scale. No radiance map or exposure times are needed, and the result is already in display
+  range
+*/
+
+//fuses the brackets in files into a width x height image. the brackets are read one at a time, twice:
+//once to sum the weights and once to blend. the result is handed to out(y, rows, strip) a strip of
+//rows at a time, in order
+bool fuseExposures(const std::vector<std::string> &files, int &width, int &height,
+                   std::function<void(int, int, const pixel*)> out);
+
+#endif
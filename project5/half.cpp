@@ -0,0 +1,96 @@
+// half.cpp
+// Ryan Painter CPSC 4040
+// IEEE half float storage for pixmaps, so large HDR images take half the memory.
+
+#include "half.h"
+
+#include <cstring>
+
+#ifdef __F16C__
+#  include <immintrin.h>
+#endif
+
+static inline unsigned int bitsOf(float x) {
+  unsigned int i;
+  memcpy(&i, &x, sizeof(i));
+  return i;
+}
+
+static inline float floatOf(unsigned int i) {
+  float x;
+  memcpy(&x, &i, sizeof(x));
+  return x;
+}
+
+/*
+  Scalar conversions on the bit patterns. Half denormals are handled with float arithmetic: adding or
+  subtracting a power of two lines the half mantissa up with the float mantissa, and the FPU does
+  the rounding.
+*/
+static inline float halfToFloat1(unsigned short h) {
+  const unsigned int shiftedExp = 0x7c00 << 13;
+  unsigned int bits = (h & 0x7fff) << 13;
+  unsigned int exp = bits & shiftedExp;
+  bits += (127 - 15) << 23;
+
+  if(exp == shiftedExp) {
+    //infinity or NaN
+    bits += (128 - 16) << 23;
+  }
+  else if(exp == 0) {
+    //zero or denormal
+    bits += 1 << 23;
+    bits = bitsOf(floatOf(bits) - floatOf(113 << 23));
+  }
+  return floatOf(bits | (unsigned int)(h & 0x8000) << 16);
+}
+
+static inline unsigned short floatToHalf1(float f) {
+  const unsigned int infinity = 255 << 23;
+  const unsigned int halfOverflow = (127 + 16) << 23;
+  const unsigned int denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+  unsigned int x = bitsOf(f);
+  unsigned int sign = x & 0x80000000u;
+  x ^= sign;
+
+  unsigned short h;
+  if(x >= halfOverflow) {
+    //too large becomes infinity, NaN stays NaN
+    h = x > infinity ? 0x7e00 : 0x7c00;
+  }
+  else if(x < (113 << 23)) {
+    //half denormal or zero
+    h = bitsOf(floatOf(x) + floatOf(denormMagic)) - denormMagic;
+  }
+  else {
+    //rebias the exponent and round the mantissa to nearest even
+    unsigned int odd = (x >> 13) & 1;
+    x -= (127 - 15) << 23;
+    x += 0xfff + odd;
+    h = x >> 13;
+  }
+  return h | (sign >> 16);
+}
+
+void halfToFloat(const unsigned short* in, int n, float* out) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = halfToFloat1(in[i]);
+}
+
+void floatToHalf(const float* in, int n, unsigned short* out) {
+  int i = 0;
+#ifdef __F16C__
+  for (; i + 8 <= n; i += 8) {
+    _mm_storeu_si128((__m128i*)(out + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+  }
+#endif
+  for (; i < n; i++)
+    out[i] = floatToHalf1(in[i]);
+}
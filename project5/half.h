@@ -0,0 +1,22 @@
+// half.h
+// Ryan Painter CPSC 4040
+// IEEE half float storage for pixmaps, so large HDR images take half the memory.
+
+#ifndef _HALF_INCLUDED_
+#define _HALF_INCLUDED_
+
+//RGBA pixel stored as four half floats, 8 bytes instead of the 16 of a pixel. values keep 11 bits of
+//precision, and magnitudes above 65504 become infinity
+struct halfPixel {
+  unsigned short r;
+  unsigned short g;
+  unsigned short b;
+  unsigned short a;
+};
+
+//convert n values between half and float storage, eight at a time with F16C when it is available.
+//float to half rounds to nearest even, the same as the F16C instruction
+void halfToFloat(const unsigned short* in, int n, float* out);
+void floatToHalf(const float* in, int n, unsigned short* out);
+
+#endif
@@ -0,0 +1,202 @@
+// local.cpp
+// Ryan Painter CPSC 4040
+// Local tone mapping: Durand and Dorsey's base/detail decomposition with a bilateral grid.
+
+#include "local.h"
+#include "parallel.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+//cells of empty grid around the image, so the blur and the interpolation never read outside it
+#define GRID_PAD 2
+
+//one grid cell: the sum of the values splatted into it, and how many there were
+struct GridCell {
+  float sum;
+  float weight;
+};
+
+//3D grid over x, y and value, with the value axis innermost so interpolation reads neighbours together
+struct Grid {
+  int width, height, depth;
+  vector<GridCell> cells;
+
+  GridCell* at(int x, int y, int z) {
+    return &cells[((size_t)y * width + x) * depth + z];
+  }
+};
+
+//blurs every line of the grid along one axis with the [1 4 6 4 1] / 16 kernel, about a gaussian of one cell.
+//count lines start at first(line) and step by stride
+template <typename First>
+static void blurLines(Grid &grid, int lines, int length, size_t stride, First first) {
+  parallelRows(lines, [&](int lineBegin, int lineEnd) {
+    vector<GridCell> line(length);
+    for (int l = lineBegin; l < lineEnd; l++) {
+      GridCell* cell = &grid.cells[first(l)];
+      for (int i = 0; i < length; i++) {
+        line[i] = cell[i * stride];
+      }
+      //the end cells are padding, which is always empty
+      for (int i = 2; i < length - 2; i++) {
+        GridCell &c = cell[i * stride];
+        c.sum = (line[i - 2].sum + 4 * line[i - 1].sum + 6 * line[i].sum + 4 * line[i + 1].sum + line[i + 2].sum) / 16;
+        c.weight = (line[i - 2].weight + 4 * line[i - 1].weight + 6 * line[i].weight + 4 * line[i + 1].weight + line[i + 2].weight) / 16;
+      }
+    }
+  });
+}
+
+//smallest and largest value of a width * height plane, found per row and merged
+static void rangeOf(const float* plane, int width, int height, float &lo, float &hi) {
+  vector<float> rowMin(height), rowMax(height);
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      const float* row = plane + (size_t)r * width;
+      float rowLo = row[0], rowHi = row[0];
+      for (int c = 1; c < width; c++) {
+        rowLo = row[c] < rowLo ? row[c] : rowLo;
+        rowHi = row[c] > rowHi ? row[c] : rowHi;
+      }
+      rowMin[r] = rowLo;
+      rowMax[r] = rowHi;
+    }
+  });
+
+  lo = rowMin[0];
+  hi = rowMax[0];
+  for (int r = 1; r < height; r++) {
+    lo = rowMin[r] < lo ? rowMin[r] : lo;
+    hi = rowMax[r] > hi ? rowMax[r] : hi;
+  }
+}
+
+void bilateralGrid(const float* in, int width, int height, float sigmaSpatial, float sigmaRange, float* out) {
+  float minValue, maxValue;
+  rangeOf(in, width, height, minValue, maxValue);
+
+  float invSpatial = 1.0f / sigmaSpatial;
+  float invRange = 1.0f / sigmaRange;
+
+  Grid grid;
+  grid.width = (int)((width - 1) * invSpatial + 0.5f) + 1 + 2 * GRID_PAD;
+  grid.height = (int)((height - 1) * invSpatial + 0.5f) + 1 + 2 * GRID_PAD;
+  grid.depth = (int)((maxValue - minValue) * invRange + 0.5f) + 1 + 2 * GRID_PAD;
+  grid.cells.assign((size_t)grid.width * grid.height * grid.depth, GridCell{0, 0});
+
+  //splat each pixel into its nearest cell. every image row lands in a single grid row, so threads
+  //that own different grid rows never write the same cell
+  vector<int> firstRow(grid.height + 1, height);
+  for (int r = height - 1; r >= 0; r--) {
+    firstRow[(int)(r * invSpatial + 0.5f) + GRID_PAD] = r;
+  }
+  for (int gy = grid.height - 1; gy > 0; gy--) {
+    firstRow[gy - 1] = firstRow[gy - 1] < firstRow[gy] ? firstRow[gy - 1] : firstRow[gy];
+  }
+
+  parallelRows(grid.height, [&](int gridBegin, int gridEnd) {
+    for (int r = firstRow[gridBegin]; r < firstRow[gridEnd]; r++) {
+      const float* row = in + (size_t)r * width;
+      int gy = (int)(r * invSpatial + 0.5f) + GRID_PAD;
+      for (int c = 0; c < width; c++) {
+        int gx = (int)(c * invSpatial + 0.5f) + GRID_PAD;
+        int gz = (int)((row[c] - minValue) * invRange + 0.5f) + GRID_PAD;
+        GridCell* cell = grid.at(gx, gy, gz);
+        cell->sum += row[c];
+        cell->weight += 1;
+      }
+    }
+  });
+
+  //separable blur along value, x and y
+  int w = grid.width, h = grid.height, d = grid.depth;
+  blurLines(grid, w * h, d, 1, [&](int l) { return (size_t)l * d; });
+  blurLines(grid, h * d, w, d, [&](int l) { return ((size_t)(l / d) * w) * d + l % d; });
+  blurLines(grid, w * d, h, (size_t)w * d, [&](int l) { return (size_t)l; });
+
+  //slice: trilinear interpolation of the sum and weight at each pixel's position, then normalize
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      const float* row = in + (size_t)r * width;
+      float* result = out + (size_t)r * width;
+      float fy = r * invSpatial + GRID_PAD;
+      int y0 = (int)fy;
+      float ty = fy - y0;
+
+      for (int c = 0; c < width; c++) {
+        float fx = c * invSpatial + GRID_PAD;
+        float fz = (row[c] - minValue) * invRange + GRID_PAD;
+        int x0 = (int)fx, z0 = (int)fz;
+        float tx = fx - x0, tz = fz - z0;
+
+        float sum = 0, weight = 0;
+        for (int j = 0; j < 2; j++) {
+          float wy = j ? ty : 1 - ty;
+          for (int i = 0; i < 2; i++) {
+            float wxy = wy * (i ? tx : 1 - tx);
+            const GridCell* cell = grid.at(x0 + i, y0 + j, z0);
+            sum += wxy * ((1 - tz) * cell[0].sum + tz * cell[1].sum);
+            weight += wxy * ((1 - tz) * cell[0].weight + tz * cell[1].weight);
+          }
+        }
+        //a pixel's own cell always holds weight, so this only guards against rounding
+        result[c] = weight > 0 ? sum / weight : row[c];
+      }
+    }
+  });
+}
+
+//spatial sigma as a fraction of the larger image side, and range sigma in log10 luminance,
+//the values Durand and Dorsey found to work for most images
+#define SIGMA_SPATIAL 0.02
+#define SIGMA_RANGE 0.4
+
+void durandBaseLayer(const float* L, int width, int height, float* base) {
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (size_t i = (size_t)rowBegin * width; i < (size_t)rowEnd * width; i++) {
+      base[i] = log10(LOG_DELTA + L[i]);
+    }
+  });
+
+  float sigmaSpatial = SIGMA_SPATIAL * (width > height ? width : height);
+  sigmaSpatial = sigmaSpatial > 1 ? sigmaSpatial : 1;
+  bilateralGrid(base, width, height, sigmaSpatial, SIGMA_RANGE, base);
+}
+
+DurandCurve durandCurve(const float* base, int width, int height, float contrast) {
+  float minBase, maxBase;
+  rangeOf(base, width, height, minBase, maxBase);
+  float compression = maxBase > minBase ? log10(contrast) / (maxBase - minBase) : 1;
+  cout << "base layer spans " << maxBase - minBase << " decades, compressed by " << compression << endl;
+
+  //with detail = log10(LOG_DELTA + L) - base, the display luminance over L reduces to
+  //(LOG_DELTA + L) / L * 10^(base * (compression - 1) - maxBase * compression), one exponential per pixel
+  float ln10 = log(10.0f);
+  DurandCurve curve;
+  curve.slope = ln10 * (compression - 1);
+  curve.offset = -ln10 * maxBase * compression;
+  return curve;
+}
+
+void durandToneMapRow(const pixel* in, pixel* out, const float* L, const float* base, int n, const DurandCurve &curve) {
+  for (int c = 0; c < n; c++) {
+    float ratio = L[c] > 0 ? (float)(LOG_DELTA + L[c]) / L[c] * exp(curve.slope * base[c] + curve.offset) : 0;
+    out[c].r = in[c].r * ratio;
+    out[c].g = in[c].g * ratio;
+    out[c].b = in[c].b * ratio;
+    out[c].a = in[c].a;
+  }
+}
+
+void durandToneMap(pixel** in, pixel** out, int width, int height, const float* L, const float* base, float contrast) {
+  DurandCurve curve = durandCurve(base, width, height, contrast);
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      size_t offset = (size_t)r * width;
+      durandToneMapRow(in[r], out[r], L + offset, base + offset, width, curve);
+    }
+  });
+}
@@ -0,0 +1,42 @@
+// local.h
+// Ryan Painter CPSC 4040
+// Local tone mapping: Durand and Dorsey's base/detail decomposition with a bilateral grid.
+
+#ifndef _LOCAL_INCLUDED_
+#define _LOCAL_INCLUDED_
+
+#include "operators.h"
+
+//edge preserving blur of the width * height plane in, written to out (which may be in).
+//sigmaSpatial is in pixels, sigmaRange in the units of the plane. the filter is approximated on a
+//grid sampled at the sigmas (Chen, Paris and Durand 2007), so its cost is linear in the pixel count
+//and does not grow with sigmaSpatial
+void bilateralGrid(const float* in, int width, int height, float sigmaSpatial, float sigmaRange, float* out);
+
+/*
+  Fast bilateral filtering tone mapping (Durand and Dorsey 2002). log10 luminance is split into a
+  base layer, the bilateral filtered image, and a detail layer, what the filter removed. Only the base
+  is compressed, to the given contrast between its darkest and brightest values, so edges and local
+  detail survive. L holds the luminance of each pixel, as computed by measureImage
+*/
+
+//computes the base layer of the image with luminance L into base (width * height floats). it does
+//not depend on the contrast, so it can be kept and reused when only the contrast changes
+void durandBaseLayer(const float* L, int width, int height, float* base);
+
+//display luminance over scene luminance is (LOG_DELTA + L) / L * exp(slope * base + offset)
+struct DurandCurve {
+  float slope;
+  float offset;
+};
+
+//curve compressing the given base layer to the target contrast, with its brightest value at white
+DurandCurve durandCurve(const float* base, int width, int height, float contrast);
+
+//maps n pixels of in to out (which may be in) with the luminance L and base layer of each pixel
+void durandToneMapRow(const pixel* in, pixel* out, const float* L, const float* base, int n, const DurandCurve &curve);
+
+//maps the in pixmap to out (which may be in) with the base layer from durandBaseLayer
+void durandToneMap(pixel** in, pixel** out, int width, int height, const float* L, const float* base, float contrast);
+
+#endif
@@ -0,0 +1,289 @@
+// merge.cpp
+// Ryan Painter CPSC 4040
+// HDR assembly: merges bracketed LDR exposures of a scene into a radiance map.
+
+#include "merge.h"
+#include "fastmath.h"
+#include "parallel.h"
+
+#include <OpenImageIO/imageio.h>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+//sample pixels per side of the grid the response is fitted to. Debevec and Malik need
+//samples * (brackets - 1) > RESPONSE_LEVELS, which 400 samples give for any two or more brackets
+#define SAMPLE_GRID 20
+#define SAMPLES (SAMPLE_GRID * SAMPLE_GRID)
+
+//weight of the smoothness term against the data, on the scale of the hat weights
+#define SMOOTHNESS 50
+
+//about how many bytes the 8 bit strips of all brackets and the merged floats may take
+#define MERGE_STRIP_BYTES (32 << 20)
+
+#define LN2 0.693147181f
+
+//trust in a pixel value: none at the ends, where the sensor clipped, most in the middle
+static inline float hatWeight(int z) {
+  return z <= RESPONSE_LEVELS / 2 - 1 ? z : RESPONSE_LEVELS - 1 - z;
+}
+
+//opens the brackets in files, checking they are all the same size
+static bool openBrackets(const vector<string> &files, vector<unique_ptr<ImageInput>> &brackets) {
+  brackets.clear();
+  for (auto &file : files) {
+    auto in = ImageInput::open(file);
+    if(!in) {
+      cerr << "Could not open " << file << ", error = " << geterror() << endl;
+      return false;
+    }
+    if(!brackets.empty() && (in->spec().width != brackets[0]->spec().width ||
+                             in->spec().height != brackets[0]->spec().height)) {
+      cerr << file << " is not the size of " << files[0] << endl;
+      return false;
+    }
+    brackets.push_back(std::move(in));
+  }
+  return true;
+}
+
+//reads rows [y, y + rows) of a bracket as 8 bit RGB, repeating grey into all three channels
+static bool readRows(ImageInput* in, int y, int rows, unsigned char* rgb) {
+  const ImageSpec &spec = in->spec();
+  int channels = spec.nchannels >= 3 ? 3 : 1;
+  if(!in->read_scanlines(0, 0, spec.y + y, spec.y + y + rows, 0, 0, channels, TypeDesc::UINT8, rgb)) {
+    cerr << "Could not read rows " << y << " to " << y + rows << ", error = " << in->geterror() << endl;
+    return false;
+  }
+  if(channels == 1) {
+    for (size_t i = (size_t)spec.width * rows; i-- > 0;) {
+      rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = rgb[i];
+    }
+  }
+  return true;
+}
+
+//solves the n x n symmetric positive definite system A x = b in place by Cholesky factorization
+static void solveCholesky(vector<double> &A, vector<double> &b, int n) {
+  for (int j = 0; j < n; j++) {
+    double* rowJ = &A[(size_t)j * n];
+    double d = rowJ[j];
+    for (int k = 0; k < j; k++)
+      d -= rowJ[k] * rowJ[k];
+    d = sqrt(d > 0 ? d : 1e-12);
+    rowJ[j] = d;
+
+    for (int i = j + 1; i < n; i++) {
+      double* rowI = &A[(size_t)i * n];
+      double s = rowI[j];
+      for (int k = 0; k < j; k++)
+        s -= rowI[k] * rowJ[k];
+      rowI[j] = s / d;
+    }
+  }
+
+  //forward then back substitution with the lower triangle
+  for (int i = 0; i < n; i++) {
+    double s = b[i];
+    for (int k = 0; k < i; k++)
+      s -= A[(size_t)i * n + k] * b[k];
+    b[i] = s / A[(size_t)i * n + i];
+  }
+  for (int i = n - 1; i >= 0; i--) {
+    double s = b[i];
+    for (int k = i + 1; k < n; k++)
+      s -= A[(size_t)k * n + i] * b[k];
+    b[i] = s / A[(size_t)i * n + i];
+  }
+}
+
+//adds the equation weight * (coefficients . x) = weight * rhs, with nonzero coefficients only at
+//index, to the normal equations
+static void addEquation(vector<double> &AtA, vector<double> &Atb, int n, const int* index, const double* coefficient,
+                        int terms, double weight, double rhs) {
+  double w2 = weight * weight;
+  for (int i = 0; i < terms; i++) {
+    for (int j = 0; j < terms; j++) {
+      AtA[(size_t)index[i] * n + index[j]] += w2 * coefficient[i] * coefficient[j];
+    }
+    Atb[index[i]] += w2 * coefficient[i] * rhs;
+  }
+}
+
+vector<float> exposureTimes(const vector<string> &files) {
+  vector<float> exposures;
+  for (auto &file : files) {
+    auto in = ImageInput::open(file);
+    float t = in ? in->spec().get_float_attribute("ExposureTime", 0) : 0;
+    if(t <= 0) {
+      cout << file << " has no exposure time, taking the brackets to be one stop apart" << endl;
+      exposures.clear();
+      for (size_t j = 0; j < files.size(); j++) {
+        exposures.push_back(ldexpf(1, j));
+      }
+      return exposures;
+    }
+    exposures.push_back(t);
+  }
+  return exposures;
+}
+
+bool estimateResponse(const vector<string> &files, const vector<float> &exposures, ResponseCurve &curve) {
+  vector<unique_ptr<ImageInput>> brackets;
+  if(!openBrackets(files, brackets))
+    return false;
+  int count = brackets.size();
+  int width = brackets[0]->spec().width;
+  int height = brackets[0]->spec().height;
+
+  //value of every sample in every bracket, read a sample row at a time
+  vector<unsigned char> samples((size_t)count * SAMPLES * 3);
+  vector<unsigned char> row((size_t)width * 3);
+  for (int j = 0; j < count; j++) {
+    for (int sy = 0; sy < SAMPLE_GRID; sy++) {
+      int y = (2 * sy + 1) * height / (2 * SAMPLE_GRID);
+      if(!readRows(brackets[j].get(), y, 1, &row[0]))
+        return false;
+      for (int sx = 0; sx < SAMPLE_GRID; sx++) {
+        int x = (2 * sx + 1) * width / (2 * SAMPLE_GRID);
+        for (int c = 0; c < 3; c++) {
+          samples[((size_t)j * SAMPLES + sy * SAMPLE_GRID + sx) * 3 + c] = row[3 * x + c];
+        }
+      }
+    }
+  }
+
+  //unknowns are g(0 .. 255) followed by the log radiance of each sample
+  int n = RESPONSE_LEVELS + SAMPLES;
+  for (int c = 0; c < 3; c++) {
+    vector<double> AtA((size_t)n * n, 0.0), Atb(n, 0.0);
+
+    //data: g(Z) - ln E = ln t for every sample in every bracket
+    for (int j = 0; j < count; j++) {
+      double lnT = log(exposures[j]);
+      for (int s = 0; s < SAMPLES; s++) {
+        int z = samples[((size_t)j * SAMPLES + s) * 3 + c];
+        int index[2] = {z, RESPONSE_LEVELS + s};
+        double coefficient[2] = {1, -1};
+        addEquation(AtA, Atb, n, index, coefficient, 2, hatWeight(z), lnT);
+      }
+    }
+
+    //fixes the scale: g(128) = 0
+    int middle = RESPONSE_LEVELS / 2;
+    double one = 1;
+    addEquation(AtA, Atb, n, &middle, &one, 1, 1, 0);
+
+    //smoothness: the second difference of g, weighted like the data
+    for (int z = 1; z < RESPONSE_LEVELS - 1; z++) {
+      int index[3] = {z - 1, z, z + 1};
+      double coefficient[3] = {1, -2, 1};
+      addEquation(AtA, Atb, n, index, coefficient, 3, SMOOTHNESS * hatWeight(z), 0);
+    }
+
+    //samples clipped in every bracket have no data, so keep their radiance defined
+    for (int i = 0; i < n; i++) {
+      AtA[(size_t)i * n + i] += 1e-6;
+    }
+
+    solveCholesky(AtA, Atb, n);
+    for (int z = 0; z < RESPONSE_LEVELS; z++) {
+      curve.g[c][z] = Atb[z];
+    }
+  }
+
+  cout << "response fitted to " << SAMPLES << " samples in " << count << " brackets, pixel values span "
+       << (curve.g[1][RESPONSE_LEVELS - 2] - curve.g[1][1]) / log(10.0) << " decades" << endl;
+  return true;
+}
+
+bool mergeExposures(const vector<string> &files, int &width, int &height, function<void(int, int, const pixel*)> out) {
+  vector<float> exposures = exposureTimes(files);
+  ResponseCurve curve;
+  if(!estimateResponse(files, exposures, curve))
+    return false;
+
+  vector<unique_ptr<ImageInput>> brackets;
+  if(!openBrackets(files, brackets))
+    return false;
+  int count = brackets.size();
+  width = brackets[0]->spec().width;
+  height = brackets[0]->spec().height;
+
+  //per bracket tables of weight * log2 radiance and weight for each pixel value, so merging a
+  //pixel is only lookups and adds
+  vector<float> weighted((size_t)count * 3 * RESPONSE_LEVELS);
+  vector<float> weight(RESPONSE_LEVELS);
+  for (int z = 0; z < RESPONSE_LEVELS; z++) {
+    weight[z] = hatWeight(z);
+  }
+  int shortest = 0, longest = 0;
+  for (int j = 0; j < count; j++) {
+    float lnT = logf(exposures[j]);
+    for (int c = 0; c < 3; c++) {
+      for (int z = 0; z < RESPONSE_LEVELS; z++) {
+        weighted[((size_t)j * 3 + c) * RESPONSE_LEVELS + z] = weight[z] * (curve.g[c][z] - lnT) / LN2;
+      }
+    }
+    if(exposures[j] < exposures[shortest])
+      shortest = j;
+    if(exposures[j] > exposures[longest])
+      longest = j;
+  }
+
+  int stripRows = MERGE_STRIP_BYTES / ((size_t)width * (3 * count + sizeof(pixel)));
+  stripRows = max(1, min(stripRows, height));
+  vector<unsigned char> raw((size_t)count * width * stripRows * 3);
+  vector<pixel> strip((size_t)width * stripRows);
+
+  for (int y = 0; y < height; y += stripRows) {
+    int rows = min(stripRows, height - y);
+    size_t bracketBytes = (size_t)width * rows * 3;
+    for (int j = 0; j < count; j++) {
+      if(!readRows(brackets[j].get(), y, rows, &raw[j * bracketBytes]))
+        return false;
+    }
+
+    parallelRows(rows, [&](int rowBegin, int rowEnd) {
+      vector<float> logRadiance((size_t)width * 3), radiance((size_t)width * 3);
+      for (int r = rowBegin; r < rowEnd; r++) {
+        size_t rowStart = (size_t)r * width * 3;
+        for (int i = 0; i < width * 3; i++) {
+          int c = i % 3;
+          float sum = 0, total = 0;
+          for (int j = 0; j < count; j++) {
+            int z = raw[j * bracketBytes + rowStart + i];
+            sum += weighted[((size_t)j * 3 + c) * RESPONSE_LEVELS + z];
+            total += weight[z];
+          }
+
+          //clipped in every bracket: brighter than the shortest exposure holds, or darker than the longest
+          if(total == 0) {
+            int j = raw[shortest * bracketBytes + rowStart + i] > RESPONSE_LEVELS / 2 ? shortest : longest;
+            int z = raw[j * bracketBytes + rowStart + i];
+            logRadiance[i] = (curve.g[c][z] - logf(exposures[j])) / LN2;
+          }
+          else {
+            logRadiance[i] = sum / total;
+          }
+        }
+        fastExp2Row(&logRadiance[0], width * 3, &radiance[0]);
+
+        pixel* dst = &strip[(size_t)r * width];
+        for (int x = 0; x < width; x++) {
+          dst[x].r = radiance[3 * x];
+          dst[x].g = radiance[3 * x + 1];
+          dst[x].b = radiance[3 * x + 2];
+          dst[x].a = 255;
+        }
+      }
+    });
+
+    out(y, rows, &strip[0]);
+  }
+  return true;
+}
@@ -0,0 +1,42 @@
+// merge.h
+// Ryan Painter CPSC 4040
+// HDR assembly: merges bracketed LDR exposures of a scene into a radiance map.
+
+#ifndef _MERGE_INCLUDED_
+#define _MERGE_INCLUDED_
+
+#include "operators.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+//pixel values of the brackets are 8 bit
+#define RESPONSE_LEVELS 256
+
+//the camera response, as the natural log of the exposure that gives each pixel value, per channel.
+//g[c][128] is 0, so radiance is relative to the exposure a mid grey pixel value takes
+struct ResponseCurve {
+  float g[3][RESPONSE_LEVELS];
+};
+
+/*
+  Debevec and Malik 1997. The response is fitted to a grid of sample pixels read from every bracket,
+  by least squares with a smoothness term, and each pixel's radiance is the weighted average of what
+  its brackets say it is. Exposure times come from each file's ExposureTime metadata. When a file
+  has none, the brackets are taken to be one stop apart in the order given, shortest first
+*/
+
+//fits the camera response to the brackets in files, with their exposure times in seconds
+bool estimateResponse(const std::vector<std::string> &files, const std::vector<float> &exposures, ResponseCurve &curve);
+
+//exposure times of the brackets in files, from their metadata when every one has it
+std::vector<float> exposureTimes(const std::vector<std::string> &files);
+
+//merges the brackets in files into a width x height radiance map, read a strip of rows at a time
+//from every bracket. each merged strip is handed to out(y, rows, strip) in order, so only the
+//strip of each bracket is ever held in memory
+bool mergeExposures(const std::vector<std::string> &files, int &width, int &height,
+                    std::function<void(int, int, const pixel*)> out);
+
+#endif
@@ -0,0 +1,263 @@
+// operators.cpp
+// Ryan Painter CPSC 4040
+// Tone mapping curves and luminance statistics.
+
+#include "operators.h"
+#include "fastmath.h"
+#include "parallel.h"
+
+#include <mutex>
+#include <vector>
+
+using namespace std;
+
+//pixels per block of curve values computed with the vectorized math, small enough for the L1 cache
+#define BLOCK 256
+
+ToneCurve baselineCurve() {
+  ToneCurve curve;
+  curve.op = BASELINE;
+  return curve;
+}
+
+ToneCurve gammaCurve(float gamma) {
+  ToneCurve curve;
+  curve.op = GAMMA;
+  curve.gamma = gamma;
+  return curve;
+}
+
+/*
+  Photographic tone reproduction (Reinhard et al. 2002), global version.
+  The scene is scaled so its log-average luminance maps to the key value, then compressed with
+  Ld = L (1 + L / white^2) / (1 + L), which burns out to pure white at the white point instead of
+  only approaching it.
+*/
+ToneCurve reinhardCurve(const LuminanceStats &stats, float key, float white) {
+  ToneCurve curve;
+  curve.op = REINHARD;
+  curve.scale = key / stats.logAverage();
+
+  if(white <= 0) {
+    white = stats.maxLuminance;
+  }
+  //white is given in scene luminance, the curve works on scaled luminance
+  float scaledWhite = curve.scale * white;
+  curve.invWhite2 = 1.0f / (scaledWhite * scaledWhite);
+  return curve;
+}
+
+ToneCurve wardCurve(const LogHistogram &hist, float displayRange) {
+  ToneCurve curve;
+  curve.op = WARD;
+
+  //only the bins between the darkest and brightest pixels take part
+  int first = 0, last = HIST_BINS - 1;
+  while(first < last && hist.count[first] == 0)
+    first++;
+  while(last > first && hist.count[last] == 0)
+    last--;
+  int bins = last - first + 1;
+  curve.lutStart = HIST_MIN_STOP + (float)first / HIST_BINS_PER_STOP;
+  //one extra edge at the end, so interpolating at the last edge stays inside the table
+  curve.lut.resize(bins + 2);
+
+  double displayStops = log2(displayRange);
+  double binStops = 1.0 / HIST_BINS_PER_STOP;
+
+  //a scene that fits on the display is scaled linearly, with its brightest pixel at white
+  if(bins * binStops <= displayStops) {
+    for (int e = 0; e <= bins; e++)
+      curve.lut[e] = (e - bins) * binStops;
+    curve.lut[bins + 1] = curve.lut[bins];
+    return curve;
+  }
+
+  //cap each bin at the share of a linear mapping, until the counts cut off are under 2.5% of the image
+  vector<double> f(hist.count.begin() + first, hist.count.begin() + last + 1);
+  double total = 0;
+  for (int i = 0; i < bins; i++)
+    total += f[i];
+  double tolerance = 0.025 * total;
+
+  while(true) {
+    double ceiling = total * binStops / displayStops;
+    double trimmed = 0;
+    for (int i = 0; i < bins; i++) {
+      if(f[i] > ceiling) {
+        trimmed += f[i] - ceiling;
+        f[i] = ceiling;
+      }
+    }
+    total -= trimmed;
+    if(trimmed <= tolerance)
+      break;
+    //the caps ate most of the histogram, so fall back to spreading the stops evenly
+    if(total <= tolerance) {
+      f.assign(bins, 1);
+      total = bins;
+      break;
+    }
+  }
+
+  //log2 display luminance is the cumulative histogram spread over the display's stops
+  double cumulative = 0;
+  curve.lut[0] = -displayStops;
+  for (int i = 0; i < bins; i++) {
+    cumulative += f[i];
+    curve.lut[i + 1] = displayStops * (cumulative / total - 1);
+  }
+  curve.lut[bins + 1] = curve.lut[bins];
+  return curve;
+}
+
+void histogramRow(const float* L, int n, LogHistogram &hist) {
+  float logL[BLOCK];
+  for (int start = 0; start < n; start += BLOCK) {
+    int count = n - start < BLOCK ? n - start : BLOCK;
+    fastLog2Row(L + start, count, logL);
+    for (int c = 0; c < count; c++) {
+      if(L[start + c] > 0) {
+        int bin = (int)((logL[c] - HIST_MIN_STOP) * HIST_BINS_PER_STOP);
+        bin = bin < 0 ? 0 : (bin >= HIST_BINS ? HIST_BINS - 1 : bin);
+        hist.count[bin]++;
+      }
+    }
+  }
+}
+
+LogHistogram histogramImage(const float* L, int width, int height) {
+  LogHistogram hist;
+  mutex merging;
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    LogHistogram own;
+    for (int r = rowBegin; r < rowEnd; r++) {
+      histogramRow(L + (size_t)r * width, width, own);
+    }
+    //counts are whole numbers, so the order threads add them in does not change the result
+    lock_guard<mutex> lock(merging);
+    hist.merge(own);
+  });
+  return hist;
+}
+
+void measureRow(const pixel* row, int n, float* L, LuminanceStats &stats) {
+  LuminanceStats rowStats;
+  float maxL = 0;
+
+  for (int c = 0; c < n; c++) {
+    L[c] = luminanceOf(row[c]);
+    maxL = L[c] > maxL ? L[c] : maxL;
+    rowStats.addLog(log(LOG_DELTA + L[c]));
+  }
+
+  rowStats.count = n;
+  rowStats.maxLuminance = maxL;
+  stats.merge(rowStats);
+}
+
+void luminanceRow(const pixel* row, int n, float* L) {
+  for (int c = 0; c < n; c++) {
+    L[c] = luminanceOf(row[c]);
+  }
+}
+
+//applies one curve to a row. the curve is a template parameter so each loop is compiled without
+//branches and can be vectorized
+template <typename Curve>
+static void scaleRow(const pixel* in, pixel* out, const float* L, int n, Curve displayLuminance) {
+  for (int c = 0; c < n; c++) {
+    float ratio = L[c] > 0 ? displayLuminance(L[c]) / L[c] : 0;
+    out[c].r = in[c].r * ratio;
+    out[c].g = in[c].g * ratio;
+    out[c].b = in[c].b * ratio;
+    out[c].a = in[c].a;
+  }
+}
+
+void toneMapRow(const pixel* in, pixel* out, const float* L, int n, const ToneCurve &curve) {
+  switch(curve.op) {
+    case BASELINE:
+      scaleRow(in, out, L, n, [](float l) { return l / (l + 1); });
+      break;
+
+    case GAMMA: {
+      //L^gamma / L = L^(gamma - 1), computed a block at a time with the vectorized power
+      float ratio[BLOCK];
+      for (int start = 0; start < n; start += BLOCK) {
+        int count = n - start < BLOCK ? n - start : BLOCK;
+        fastPowRow(L + start, count, curve.gamma - 1, ratio);
+        for (int c = 0; c < count; c++) {
+          out[start + c].r = in[start + c].r * ratio[c];
+          out[start + c].g = in[start + c].g * ratio[c];
+          out[start + c].b = in[start + c].b * ratio[c];
+          out[start + c].a = in[start + c].a;
+        }
+      }
+      break;
+    }
+
+    case REINHARD: {
+      float scale = curve.scale, invWhite2 = curve.invWhite2;
+      scaleRow(in, out, L, n, [=](float l) {
+        float scaled = scale * l;
+        return scaled * (1 + scaled * invWhite2) / (1 + scaled);
+      });
+      break;
+    }
+
+    case WARD: {
+      //log2 luminance, then the display value interpolated between the edges of its bin
+      float logL[BLOCK], display[BLOCK];
+      const float* lut = &curve.lut[0];
+      float lastEdge = curve.lut.size() - 2;
+      for (int start = 0; start < n; start += BLOCK) {
+        int count = n - start < BLOCK ? n - start : BLOCK;
+        fastLog2Row(L + start, count, logL);
+        for (int c = 0; c < count; c++) {
+          float x = (logL[c] - curve.lutStart) * HIST_BINS_PER_STOP;
+          x = x < 0 ? 0 : (x > lastEdge ? lastEdge : x);
+          int i = (int)x;
+          display[c] = lut[i] + (x - i) * (lut[i + 1] - lut[i]);
+        }
+        fastExp2Row(display, count, display);
+        for (int c = 0; c < count; c++) {
+          float ratio = L[start + c] > 0 ? display[c] / L[start + c] : 0;
+          out[start + c].r = in[start + c].r * ratio;
+          out[start + c].g = in[start + c].g * ratio;
+          out[start + c].b = in[start + c].b * ratio;
+          out[start + c].a = in[start + c].a;
+        }
+      }
+      break;
+    }
+  }
+}
+
+void toneMapRow(pixel* row, const float* L, int n, const ToneCurve &curve) {
+  toneMapRow(row, row, L, n, curve);
+}
+
+LuminanceStats measureImage(pixel** pixmap, int width, int height, float* L) {
+  //each row is measured on its own, then the rows are merged in order
+  vector<LuminanceStats> rows(height);
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      measureRow(pixmap[r], width, L + (size_t)r * width, rows[r]);
+    }
+  });
+
+  LuminanceStats stats;
+  for (int r = 0; r < height; r++) {
+    stats.merge(rows[r]);
+  }
+  return stats;
+}
+
+void toneMapImage(pixel** in, pixel** out, int width, int height, const float* L, const ToneCurve &curve) {
+  parallelRows(height, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      toneMapRow(in[r], out[r], L + (size_t)r * width, width, curve);
+    }
+  });
+}
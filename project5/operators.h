@@ -0,0 +1,128 @@
+// operators.h
+// Ryan Painter CPSC 4040
+// Tone mapping curves and luminance statistics, shared by the interactive viewer and the
+// streaming path for images too large to hold in memory.
+
+#ifndef _OPERATORS_INCLUDED_
+#define _OPERATORS_INCLUDED_
+
+#include <cmath>
+#include <vector>
+
+//struct that stores the red, green, blue, and alpha channel of a pixel
+struct pixel {
+  float r;
+  float g;
+  float b;
+  float a;
+};
+
+//luminance of a pixel using the luma function from Y'UV space
+inline float luminanceOf(const pixel &p) {
+  return (0.299f * p.r) + (0.587f * p.g) + (0.114f * p.b);
+}
+
+//small offset so black pixels do not send the log to -infinity
+#define LOG_DELTA 0.0001
+
+//running statistics of scene luminance. the log sum uses Kahan summation, and statistics from
+//separate rows or strips are merged in order so the result does not depend on how work was split
+struct LuminanceStats {
+  double logSum;
+  double compensation;
+  double count;
+  float maxLuminance;
+
+  LuminanceStats(): logSum(0), compensation(0), count(0), maxLuminance(0) {}
+
+  void addLog(double value) {
+    double y = value - compensation;
+    double t = logSum + y;
+    compensation = (t - logSum) - y;
+    logSum = t;
+  }
+
+  //the other side's compensation is still owed to its sum, so it is carried over with it
+  void merge(const LuminanceStats &other) {
+    addLog(other.logSum);
+    compensation += other.compensation;
+    count += other.count;
+    maxLuminance = other.maxLuminance > maxLuminance ? other.maxLuminance : maxLuminance;
+  }
+
+  float logAverage() const {
+    return exp(logSum / count);
+  }
+};
+
+//histogram of log2 luminance over a fixed range of stops, fine enough to build the histogram
+//adjustment curve from. luminance outside the range counts in the end bins, black is left out
+#define HIST_MIN_STOP -24
+#define HIST_MAX_STOP 24
+#define HIST_BINS_PER_STOP 8
+#define HIST_BINS ((HIST_MAX_STOP - HIST_MIN_STOP) * HIST_BINS_PER_STOP)
+
+struct LogHistogram {
+  std::vector<double> count;
+
+  LogHistogram(): count(HIST_BINS, 0) {}
+
+  void merge(const LogHistogram &other) {
+    for (int i = 0; i < HIST_BINS; i++)
+      count[i] += other.count[i];
+  }
+};
+
+//the tone curves, and the parameters each one needs
+enum ToneOperator { BASELINE, GAMMA, REINHARD, WARD };
+
+struct ToneCurve {
+  ToneOperator op;
+  float gamma;      //GAMMA: display luminance is L^gamma
+  float scale;      //REINHARD: key value / log-average luminance
+  float invWhite2;  //REINHARD: 1 / (scaled white point)^2
+  std::vector<float> lut;  //WARD: log2 display luminance at each bin edge, from lutStart in steps of one bin
+  float lutStart;          //WARD: log2 luminance of the first edge
+};
+
+ToneCurve baselineCurve();
+ToneCurve gammaCurve(float gamma);
+
+//Reinhard curve for an image with the given statistics. a white point <= 0 uses the brightest pixel
+ToneCurve reinhardCurve(const LuminanceStats &stats, float key, float white);
+
+/*
+  Histogram adjustment (Ward Larson, Rushmeier and Piatko 1997), without the models of human vision.
+  Display log luminance follows the cumulative histogram of scene log luminance, so ranges holding
+  many pixels get more of the display's contrast. Each bin is first capped so no range is stretched
+  more than a linear mapping of the scene onto the display would, which keeps large flat areas from
+  turning noisy. displayRange is the ratio of the brightest to the darkest display luminance
+*/
+ToneCurve wardCurve(const LogHistogram &hist, float displayRange);
+
+//adds the n luminances in L to hist
+void histogramRow(const float* L, int n, LogHistogram &hist);
+
+//histogram of a width * height plane of luminance. each thread counts into its own histogram and
+//they are added up at the end, so no counts are shared between threads
+LogHistogram histogramImage(const float* L, int width, int height);
+
+//computes the luminance of n pixels into L and adds them to stats
+void measureRow(const pixel* row, int n, float* L, LuminanceStats &stats);
+
+//computes the luminance of n pixels into L only, for when the statistics are already known
+void luminanceRow(const pixel* row, int n, float* L);
+
+//scales the color of n pixels so each luminance L becomes the display luminance of the curve,
+//reading from in and writing to out in one pass. black pixels stay black, alpha is copied
+void toneMapRow(const pixel* in, pixel* out, const float* L, int n, const ToneCurve &curve);
+
+//in place version of the above
+void toneMapRow(pixel* row, const float* L, int n, const ToneCurve &curve);
+
+//whole pixmap versions of the above, split across threads by rows. L holds width * height floats.
+//in and out may be the same pixmap
+LuminanceStats measureImage(pixel** pixmap, int width, int height, float* L);
+void toneMapImage(pixel** in, pixel** out, int width, int height, const float* L, const ToneCurve &curve);
+
+#endif
@@ -0,0 +1,88 @@
+// powbench.cpp
+// Ryan Painter CPSC 4040
+// Times the gamma curve's power function against the C library on the luminance of an image,
+// and reports the largest relative error. usage: ./powbench <filename> [gamma]
+
+#include "fastmath.h"
+#include "operators.h"
+
+#include <OpenImageIO/imageio.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+//each kernel is timed this many times and the fastest run is kept
+#define RUNS 10
+
+//milliseconds taken by the fastest of RUNS calls to work
+template <typename F>
+double timeRuns(F work) {
+  double best = 1e30;
+  for (int run = 0; run < RUNS; run++) {
+    auto start = chrono::steady_clock::now();
+    work();
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    best = ms < best ? ms : best;
+  }
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    cerr << "incorrect usage. correct usage is: \"./powbench <filename> [gamma]\"" << endl;
+    exit(-1);
+  }
+  float gamma = argc >= 3 ? atof(argv[2]) : 1.0 / 2.2;
+
+  auto in = ImageInput::open(argv[1]);
+  if(!in) {
+    cerr << "Could not open " << argv[1] << ", error = " << geterror() << endl;
+    exit(-1);
+  }
+  const ImageSpec &spec = in->spec();
+  int channels = spec.nchannels;
+  size_t n = (size_t)spec.width * spec.height;
+  vector<float> pixels(n * channels);
+  in->read_image(TypeDesc::FLOAT, &pixels[0]);
+  in->close();
+
+  //the gamma curve raises luminance to gamma - 1 to get each pixel's scale factor
+  vector<float> L(n);
+  for (size_t i = 0; i < n; i++) {
+    const float* p = &pixels[i * channels];
+    pixel px = { p[0], channels >= 3 ? p[1] : p[0], channels >= 3 ? p[2] : p[0], 1 };
+    L[i] = luminanceOf(px);
+  }
+  float power = gamma - 1;
+
+  vector<float> exact(n), fast(n);
+  double libmTime = timeRuns([&]() {
+    for (size_t i = 0; i < n; i++) {
+      exact[i] = L[i] > 0 ? powf(L[i], power) : 0;
+    }
+  });
+  double fastTime = timeRuns([&]() {
+    fastPowRow(&L[0], n, power, &fast[0]);
+  });
+
+  double maxError = 0;
+  for (size_t i = 0; i < n; i++) {
+    if(exact[i] > 0 && isfinite(exact[i])) {
+      double error = fabs((double)fast[i] - exact[i]) / exact[i];
+      maxError = error > maxError ? error : maxError;
+    }
+    else if(fast[i] != exact[i] && isfinite(exact[i])) {
+      maxError = 1e30;
+    }
+  }
+
+  cout << argv[1] << ": " << spec.width << "x" << spec.height << ", L^" << power << endl;
+  cout << "libm powf:   " << libmTime << " ms, " << n / libmTime / 1000 << " Mpixels/s" << endl;
+  cout << "fastPowRow:  " << fastTime << " ms, " << n / fastTime / 1000 << " Mpixels/s" << endl;
+  cout << "speedup " << libmTime / fastTime << "x, max relative error " << maxError << endl;
+  return 0;
+}
@@ -0,0 +1,179 @@
+// stream.cpp
+// Ryan Painter CPSC 4040
+// Tone mapping of images too large to hold in memory, a strip of scanlines or tiles at a time.
+
+#include "stream.h"
+#include "parallel.h"
+#include "writer.h"
+
+#include <OpenImageIO/imageio.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+//about how many bytes of RGBA floats one strip may take
+#define STRIP_BYTES (32 << 20)
+
+//reads an image a strip of whole rows at a time, from scanline or tiled files alike
+struct StripReader {
+  unique_ptr<ImageInput> in;
+  ImageSpec spec;
+  int rowsPerStrip;
+  vector<float> raw;
+
+  bool open(string filename) {
+    in = ImageInput::open(filename);
+    if(!in) {
+      cerr << "Could not open " << filename << ", error = " << geterror() << endl;
+      return false;
+    }
+    spec = in->spec();
+
+    //tiled files are read a row of tiles at a time, so strips are a whole number of tiles high
+    rowsPerStrip = STRIP_BYTES / ((size_t)spec.width * sizeof(pixel));
+    if(spec.tile_height > 0) {
+      rowsPerStrip = rowsPerStrip / spec.tile_height * spec.tile_height;
+      if(rowsPerStrip < spec.tile_height)
+        rowsPerStrip = spec.tile_height;
+    }
+    if(rowsPerStrip < 1)
+      rowsPerStrip = 1;
+    if(rowsPerStrip > spec.height)
+      rowsPerStrip = spec.height;
+
+    raw.resize((size_t)spec.width * rowsPerStrip * spec.nchannels);
+    return true;
+  }
+
+  //reads rows [y, y + rows) into rgba, filling in green, blue and alpha for images without them
+  bool read(int y, int rows, pixel* rgba) {
+    int channels = spec.nchannels;
+    bool ok;
+    if(spec.tile_width > 0) {
+      ok = in->read_tiles(0, 0, spec.x, spec.x + spec.width, spec.y + y, spec.y + y + rows,
+                          spec.z, spec.z + 1, 0, channels, TypeDesc::FLOAT, &raw[0]);
+    }
+    else {
+      ok = in->read_scanlines(0, 0, spec.y + y, spec.y + y + rows, 0, 0, channels, TypeDesc::FLOAT, &raw[0]);
+    }
+    if(!ok) {
+      cerr << "Could not read rows " << y << " to " << y + rows << ", error = " << in->geterror() << endl;
+      return false;
+    }
+
+    size_t n = (size_t)spec.width * rows;
+    const float* src = &raw[0];
+    for (size_t i = 0; i < n; i++, src += channels) {
+      rgba[i].r = src[0];
+      rgba[i].g = channels >= 3 ? src[1] : src[0];
+      rgba[i].b = channels >= 3 ? src[2] : src[0];
+      rgba[i].a = channels >= 4 ? src[3] : 1.0f;
+    }
+    return true;
+  }
+};
+
+//measures the rows of a strip in parallel and merges their statistics in order
+static void measureStrip(pixel* strip, float* L, int width, int rows, LuminanceStats &stats) {
+  vector<LuminanceStats> rowStats(rows);
+  parallelRows(rows, [&](int rowBegin, int rowEnd) {
+    for (int r = rowBegin; r < rowEnd; r++) {
+      measureRow(strip + (size_t)r * width, width, L + (size_t)r * width, rowStats[r]);
+    }
+  });
+
+  for (int r = 0; r < rows; r++) {
+    stats.merge(rowStats[r]);
+  }
+}
+
+bool streamToneMap(string infile, string outfile, ToneOperator op, float param, float white, Encoding encoding) {
+  StripReader reader;
+  if(!reader.open(infile))
+    return false;
+
+  int width = reader.spec.width;
+  int height = reader.spec.height;
+  int stripRows = reader.rowsPerStrip;
+  vector<pixel> strip((size_t)width * stripRows);
+  vector<float> L((size_t)width * stripRows);
+
+  cout << width << "x" << height << ", " << stripRows << " rows per strip" << endl;
+
+  //first pass: global statistics, only needed by curves that depend on the whole image
+  LuminanceStats stats;
+  LogHistogram hist;
+  if(op == REINHARD || op == WARD) {
+    for (int y = 0; y < height; y += stripRows) {
+      int rows = min(stripRows, height - y);
+      if(!reader.read(y, rows, &strip[0]))
+        return false;
+      measureStrip(&strip[0], &L[0], width, rows, stats);
+      if(op == WARD)
+        hist.merge(histogramImage(&L[0], width, rows));
+    }
+    cout << "log-average luminance " << stats.logAverage() << ", brightest pixel " << stats.maxLuminance << endl;
+  }
+
+  ToneCurve curve;
+  switch(op) {
+    case BASELINE:
+      curve = baselineCurve();
+      break;
+    case GAMMA:
+      curve = gammaCurve(param);
+      break;
+    case REINHARD:
+      curve = reinhardCurve(stats, param, white);
+      break;
+    case WARD:
+      curve = wardCurve(hist, param);
+      break;
+  }
+
+  std::unique_ptr<ImageOutput> out = ImageOutput::create(outfile);
+  if(!out) {
+    cerr << "Could not create output image for " << outfile << ", error = " << geterror() << endl;
+    return false;
+  }
+  int outChannels = reader.spec.nchannels >= 4 ? 4 : 3;
+  TypeDesc type = encoding.bits == 16 ? TypeDesc::UINT16 : TypeDesc::UINT8;
+  ImageSpec spec(width, height, outChannels, type);
+  size_t rowBytes = (size_t)width * outChannels * type.size();
+  vector<unsigned char> encoded(rowBytes * stripRows);
+  if(!out->open(outfile, spec)) {
+    cerr << "Could not open " << outfile << ", error = " << out->geterror() << endl;
+    return false;
+  }
+
+  //second pass: map and encode each strip and write it out while it is still in memory
+  for (int y = 0; y < height; y += stripRows) {
+    int rows = min(stripRows, height - y);
+    if(!reader.read(y, rows, &strip[0]))
+      return false;
+
+    //the statistics came from the first pass, so only the luminance is needed here, not its log
+    parallelRows(rows, [&](int rowBegin, int rowEnd) {
+      for (int r = rowBegin; r < rowEnd; r++) {
+        luminanceRow(&strip[(size_t)r * width], width, &L[(size_t)r * width]);
+        toneMapRow(&strip[(size_t)r * width], &L[(size_t)r * width], width, curve);
+        encodeRow(&strip[(size_t)r * width], width, outChannels, encoding, &encoded[r * rowBytes]);
+      }
+    });
+
+    if(!out->write_scanlines(y, y + rows, 0, type, &encoded[0])) {
+      cerr << "Could not write image to " << outfile << ", error = " << out->geterror() << endl;
+      return false;
+    }
+  }
+
+  if(!out->close()) {
+    cerr << "Could not close " << outfile << ", error = " << out->geterror() << endl;
+    return false;
+  }
+  cout << "File saved" << endl;
+  return true;
+}
@@ -0,0 +1,20 @@
+// stream.h
+// Ryan Painter CPSC 4040
+// Tone mapping of images too large to hold in memory, a strip of scanlines or tiles at a time.
+
+#ifndef _STREAM_INCLUDED_
+#define _STREAM_INCLUDED_
+
+#include "operators.h"
+#include "writer.h"
+
+#include <string>
+
+//tone maps infile into outfile in two passes over the input: the first gathers luminance statistics,
+//the second maps each strip and writes it out. memory use is bounded by the strip size, not the image.
+//param is the gamma for GAMMA, the key value for REINHARD and the display range for WARD,
+//white the Reinhard white point. rows are written in the given encoding
+bool streamToneMap(std::string infile, std::string outfile, ToneOperator op, float param, float white,
+                   Encoding encoding);
+
+#endif
@@ -1,6 +1,18 @@
 // Ryan Painter CPSC 4040
 // This program reads and displays image files. Read images can be color inverted, noisified, and saved.
+#include "fuse.h"
+#include "half.h"
+#include "local.h"
+#include "merge.h"
+#include "operators.h"
+#include "parallel.h"
+#include "stream.h"
+#include "writer.h"
+
 #include <OpenImageIO/imageio.h>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <math.h>
 
@@ -11,25 +23,215 @@
 #  include <GL/glut.h>
 #endif
 
+//half float pixel type, from OpenGL 3.0 and ARB_half_float_pixel
+#ifndef GL_HALF_FLOAT
+#  define GL_HALF_FLOAT 0x140B
+#endif
+
 using namespace std;
 OIIO_NAMESPACE_USING
 
 static int icolor = 0;
 
-//struct that stores the red, green, blue, and alpha channel of a pixel
-struct pixel {
-  float r;
-  float g;
-  float b;
-  float a;
-};
-
 bool displayOriginal = false;
-struct pixel** pixmap;
-struct pixel** original;
 unsigned int width;
 unsigned int height;
 
+/*
+  One level of the mip pyramid. Level 0 is the image as read, and each level after it is half the
+  size of the one before, box filtered. Keys map only the level shown in the window, which is the
+  largest one that fits on the screen, so editing does not slow down with the image size. Other
+  levels, including the full resolution one, are marked stale and mapped when they are next shown
+  or written.
+*/
+struct Level {
+  int width;
+  int height;
+  pixel** original;
+  pixel** pixmap;            //allocated the first time the level is mapped
+  halfPixel** halfOriginal;  //with -half, level 0 keeps its images in these instead
+  halfPixel** halfPixmap;
+  vector<float> luminance;   //luminance of the original, computed with the pixmap
+  vector<float> baseLayer;   //base layer for local tone mapping, built the first time it is used
+  bool stale;                //pixmap does not show the current operator yet
+
+  Level(): width(0), height(0), original(NULL), pixmap(NULL), halfOriginal(NULL), halfPixmap(NULL), stale(true) {}
+};
+
+vector<Level> levels;
+int shown = 0;
+
+//the operator of the last key pressed, applied to a level when it is mapped. empty shows the original
+function<void(Level&)> current;
+
+//statistics of the full resolution luminance, used by Reinhard tone mapping at every level
+LuminanceStats stats;
+
+//with -half the full resolution original and displayed images are kept as half floats, halving
+//their memory. rows are converted to float as they are processed
+bool halfMode = false;
+
+//bits per channel and transfer curve of written files. -16 and -srgb on the command line change them
+Encoding encoding = {8, false};
+
+//allocates a h x w pixmap as one contiguous block
+template <typename Pixel>
+Pixel** allocPixmap(int w, int h) {
+  Pixel** rows = new Pixel * [h];
+  rows[0] = new Pixel[(size_t)w * h];
+  for (int i = 1; i < h; i++) {
+    rows[i] = rows[i-1] + w;
+  }
+  return rows;
+}
+
+//reads the image straight into half float storage, so it never exists as floats in full
+void readHalfImage(unique_ptr<ImageInput> &in, int channels, Level &level) {
+  vector<unsigned short> pixels((size_t)width * height * channels);
+  in->read_image(TypeDesc::HALF, &pixels[0]);
+  in->close();
+
+  unsigned short opaque;
+  float alpha = 255;
+  floatToHalf(&alpha, 1, &opaque);
+
+  level.halfOriginal = allocPixmap<halfPixel>(width, height);
+  size_t i = 0;
+  for (int r = 0; r < height; r++) {
+    for (int c = 0; c < width; c++) {
+      halfPixel &p = level.halfOriginal[r][c];
+      p.r = pixels[i++];
+      p.g = channels == 1 ? p.r : pixels[i++];
+      p.b = channels == 1 ? p.r : pixels[i++];
+      p.a = channels == 4 ? pixels[i++] : opaque;
+    }
+  }
+}
+
+//row r of a level's original image as floats. half float levels are converted into buffer
+const pixel* originalRow(Level &level, int r, pixel* buffer) {
+  if(!level.halfOriginal)
+    return level.original[r];
+  halfToFloat(&level.halfOriginal[r][0].r, 4 * level.width, &buffer->r);
+  return buffer;
+}
+
+//row r of what a level shows, the original or its pixmap, as floats
+const pixel* displayRow(Level &level, int r, pixel* buffer) {
+  if(displayOriginal)
+    return originalRow(level, r, buffer);
+  if(!level.halfPixmap)
+    return level.pixmap[r];
+  halfToFloat(&level.halfPixmap[r][0].r, 4 * level.width, &buffer->r);
+  return buffer;
+}
+
+//renders every row of a level's original into its pixmap with map(in, out, row), split across
+//threads. half float levels are mapped a row at a time in a float buffer and stored back as half floats
+template <typename F>
+void renderRows(Level &level, F map) {
+  auto start = chrono::steady_clock::now();
+  bool half = level.halfOriginal != NULL;
+  parallelRows(level.height, [&](int rowBegin, int rowEnd) {
+    vector<pixel> buffer(half ? level.width : 0);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      if(half) {
+        map(originalRow(level, r, &buffer[0]), &buffer[0], r);
+        floatToHalf(&buffer[0].r, 4 * level.width, &level.halfPixmap[r][0].r);
+      }
+      else {
+        map(level.original[r], level.pixmap[r], r);
+      }
+    }
+  });
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  cout << "rendered " << level.width << "x" << level.height << " in " << ms << " ms" << endl;
+}
+
+//computes the luminance plane of a level's original, returning its statistics
+LuminanceStats measureLevel(Level &level) {
+  level.luminance.resize((size_t)level.width * level.height);
+  vector<LuminanceStats> rowStats(level.height);
+  parallelRows(level.height, [&](int rowBegin, int rowEnd) {
+    vector<pixel> buffer(level.halfOriginal ? level.width : 0);
+    for (int r = rowBegin; r < rowEnd; r++) {
+      measureRow(originalRow(level, r, &buffer[0]), level.width, &level.luminance[(size_t)r * level.width], rowStats[r]);
+    }
+  });
+
+  LuminanceStats total;
+  for (int r = 0; r < level.height; r++) {
+    total.merge(rowStats[r]);
+  }
+  return total;
+}
+
+//brings a level's pixmap up to date with the current operator, allocating it the first time
+void updateLevel(Level &level) {
+  if(level.halfOriginal && !level.halfPixmap) {
+    level.halfPixmap = allocPixmap<halfPixel>(level.width, level.height);
+  }
+  if(!level.halfOriginal && !level.pixmap) {
+    level.pixmap = allocPixmap<pixel>(level.width, level.height);
+  }
+  if(level.luminance.empty()) {
+    measureLevel(level);
+  }
+  if(!level.stale)
+    return;
+
+  if(current) {
+    current(level);
+  }
+  else if(level.halfOriginal) {
+    memcpy(level.halfPixmap[0], level.halfOriginal[0], (size_t)level.width * level.height * sizeof(halfPixel));
+  }
+  else {
+    memcpy(level.pixmap[0], level.original[0], (size_t)level.width * level.height * sizeof(pixel));
+  }
+  level.stale = false;
+}
+
+//makes op the current operator. the shown level is mapped now, the rest when they are needed
+void applyOperator(function<void(Level&)> op) {
+  current = op;
+  for (auto &level : levels) {
+    level.stale = true;
+  }
+  updateLevel(levels[shown]);
+}
+
+//adds levels, each a 2x2 box filter of the last, until one fits in maxWidth x maxHeight
+void buildPyramid(int maxWidth, int maxHeight) {
+  while((levels.back().width > maxWidth || levels.back().height > maxHeight) &&
+        (levels.back().width > 1 || levels.back().height > 1)) {
+    Level &prev = levels.back();
+    Level next;
+    next.width = (prev.width + 1) / 2;
+    next.height = (prev.height + 1) / 2;
+    next.original = allocPixmap<pixel>(next.width, next.height);
+
+    parallelRows(next.height, [&](int rowBegin, int rowEnd) {
+      vector<pixel> buffer0(prev.halfOriginal ? prev.width : 0), buffer1(buffer0.size());
+      for (int r = rowBegin; r < rowEnd; r++) {
+        //odd sizes repeat the last row or column
+        const pixel* row0 = originalRow(prev, 2 * r, &buffer0[0]);
+        const pixel* row1 = originalRow(prev, min(2 * r + 1, prev.height - 1), &buffer1[0]);
+        pixel* out = next.original[r];
+        for (int c = 0; c < next.width; c++) {
+          int c0 = 2 * c, c1 = min(2 * c + 1, prev.width - 1);
+          out[c].r = 0.25f * (row0[c0].r + row0[c1].r + row1[c0].r + row1[c1].r);
+          out[c].g = 0.25f * (row0[c0].g + row0[c1].g + row1[c0].g + row1[c1].g);
+          out[c].b = 0.25f * (row0[c0].b + row0[c1].b + row1[c0].b + row1[c1].b);
+          out[c].a = 0.25f * (row0[c0].a + row0[c1].a + row1[c0].a + row1[c1].a);
+        }
+      }
+    });
+    levels.push_back(next);
+  }
+  shown = levels.size() - 1;
+}
+
 
 //read from an image file and convert it to a pixmap with red, green, blue, and alpha channels
 void readImage(string fileName) {
@@ -42,89 +244,100 @@ void readImage(string fileName) {
   width = spec.width;
   height = spec.height;
   int channels = spec.nchannels;
+
+  levels.assign(1, Level());
+  Level &full = levels[0];
+  full.width = width;
+  full.height = height;
+
+  if(halfMode) {
+    readHalfImage(in, channels, full);
+    stats = measureLevel(full);
+    return;
+  }
   vector<float> pixels (width*height*channels);
   in->read_image (TypeDesc::FLOAT, &pixels[0]);
   in->close ();
 
-  //allocation for pixmap
-  pixmap = new pixel * [height];
-  pixmap[0] = new pixel[width * height];
+  //allocation for the original
+  pixel** original = allocPixmap<pixel>(width, height);
 
-  for (int i = 1; i < height; i++) {
-    pixmap[i] = pixmap[i-1] + width;
-  }
-
-  //iterates through the pixmap and pixels vector copying all color values into their corresponding pixel in pixmap
+  //iterates through the original and pixels vector copying all color values into their corresponding pixel in original
   int i = 0;
   for (int r = 0; r < height; r++) {
     for (int c = 0; c < width; c++) {
-      pixmap[r][c].r = pixels[i++];
+      original[r][c].r = pixels[i++];
 
       //if image is greyscale, copy red value into blue and green to maintain color
       if(channels == 1) {
-        pixmap[r][c].g = pixmap[r][c].r;
-        pixmap[r][c].b = pixmap[r][c].r;
+        original[r][c].g = original[r][c].r;
+        original[r][c].b = original[r][c].r;
       }
       //else read the green and blue channels
       else {
-        pixmap[r][c].g = pixels[i++];
-        pixmap[r][c].b = pixels[i++];
+        original[r][c].g = pixels[i++];
+        original[r][c].b = pixels[i++];
       }
 
       //if image has alpha channel read it
       if(channels == 4) {
-        pixmap[r][c].a = pixels[i++];
+        original[r][c].a = pixels[i++];
       }
       //else set to max oppacity
       else {
-        pixmap[r][c].a = 255;
+        original[r][c].a = 255;
       }
     }
   }
 
-  original = new pixel * [height];
-  original[0] = new pixel[width * height];
-
-  for (int i = 1; i < height; i++) {
-    original[i] = original[i-1] + width;
-  }
-
-  for(int r = 0; r < height; r++) {
-    for(int c = 0; c < width; c++) {
-      original[r][c].r = pixmap[r][c].r;
-      original[r][c].g = pixmap[r][c].g;
-      original[r][c].b = pixmap[r][c].b;
-      original[r][c].a = pixmap[r][c].a;
-    }
-  }
+  full.original = original;
+  stats = measureLevel(full);
 }
 
-void resetImage() {
-  for(int r = 0; r < height; r++) {
-    for(int c = 0; c < width; c++) {
-      pixmap[r][c].r = original[r][c].r;
-      pixmap[r][c].g = original[r][c].g;
-      pixmap[r][c].b = original[r][c].b;
-      pixmap[r][c].a = original[r][c].a;
+//how bracketed exposures become one image: mergeExposures or fuseExposures
+typedef bool (*Assembler)(const vector<string>&, int&, int&, function<void(int, int, const pixel*)>);
+
+//builds the original from bracketed exposures, a strip of rows at a time, so the brackets are
+//never all held in memory. with -half the result is stored as half floats as it arrives
+void assembleImage(const vector<string> &files, Assembler assemble) {
+  levels.assign(1, Level());
+  Level &full = levels[0];
+  int w, h;
+  bool assembled = assemble(files, w, h, [&](int y, int rows, const pixel* strip) {
+    if(y == 0) {
+      full.width = width = w;
+      full.height = height = h;
+      if(halfMode)
+        full.halfOriginal = allocPixmap<halfPixel>(w, h);
+      else
+        full.original = allocPixmap<pixel>(w, h);
     }
+    if(halfMode)
+      floatToHalf(&strip->r, 4 * w * rows, &full.halfOriginal[y][0].r);
+    else
+      memcpy(full.original[y], strip, (size_t)w * rows * sizeof(pixel));
+  });
+  if(!assembled) {
+    levels.clear();
+    return;
   }
+  stats = measureLevel(full);
 }
 
-void baselineToneMapping() {
-  float luminance = 0;
-  float displayLuminance = 0;
+//renders a level's original through a curve into its pixmap in a single pass
+void renderCurve(Level &level, const ToneCurve &curve) {
+  renderRows(level, [&](const pixel* in, pixel* out, int r) {
+    toneMapRow(in, out, &level.luminance[(size_t)r * level.width], level.width, curve);
+  });
+}
 
-  for (int r = 0; r < height; r++) {
-    for (int c = 0; c < width; c++) {
-      //find luminance for each pixel using the luma function from Y'UV space and use it find compressed luminance
-      luminance = (0.299 * pixmap[r][c].r) + (0.587 * pixmap[r][c].g) + (0.114 * pixmap[r][c].b);
-      displayLuminance = luminance / (luminance + 1);
+//applies the same curve at every level
+void applyCurve(const ToneCurve &curve) {
+  applyOperator([curve](Level &level) { renderCurve(level, curve); });
+}
 
-      pixmap[r][c].r = (displayLuminance/luminance) * pixmap[r][c].r;
-      pixmap[r][c].g = (displayLuminance/luminance) * pixmap[r][c].g;
-      pixmap[r][c].b = (displayLuminance/luminance) * pixmap[r][c].b;
-    }
-  }
+void baselineToneMapping() {
+  applyCurve(baselineCurve());
 }
 
 void gammaCompression() {
@@ -155,47 +368,99 @@ void gammaCompression() {
     }
   }
 
-  float luminance = 0;
-  float displayLuminance = 0;
+  applyCurve(gammaCurve(gamma));
+}
 
-  for (int r = 0; r < height; r++) {
-    for (int c = 0; c < width; c++) {
-      //find luminance for each pixel using the luma function from Y'UV space and use it find compressed luminance
-      luminance = (0.299 * pixmap[r][c].r) + (0.587 * pixmap[r][c].g) + (0.114 * pixmap[r][c].b);
-      displayLuminance = pow(luminance, gamma);
+//asks the user whether to use a custom value for a parameter, returning the default if not
+float promptValue(string name, float defaultValue) {
+  char response;
+  float value = defaultValue;
 
-      pixmap[r][c].r = (displayLuminance/luminance) * pixmap[r][c].r;
-      pixmap[r][c].g = (displayLuminance/luminance) * pixmap[r][c].g;
-      pixmap[r][c].b = (displayLuminance/luminance) * pixmap[r][c].b;
+  bool run = true;
+  while(run) {
+    cout << "would you like to use a custom " << name << "? (Y/N): ";
+    cin >> response;
+    switch(response) {
+      case 'y':
+      case 'Y':
+        run = false;
+        cout << "enter a " << name << ": ";
+        cin >> value;
+        break;
+      case 'n':
+      case 'N':
+        run = false;
+        break;
+      default:
+        cout << "enter a valid response" << endl;
+        break;
     }
   }
+
+  return value;
 }
 
-//handles the rendering of images to the viewport
-void renderImage(){
+//photographic (Reinhard) tone mapping, from the statistics gathered when the image was read
+void reinhardToneMapping() {
+  float key = promptValue("key value", 0.18);
+  float white = promptValue("white point (0 for the brightest pixel)", 0);
 
-  //copy the 2d array of pixels structs into a 1d array of float
-  float pixels[width * height * 4];
-  int i = 0;
-  if(displayOriginal) {
-    for (int r = 0; r < height; r++) {
-      for (int c = 0; c < width; c++) {
-        pixels[i++] = original[r][c].r;
-        pixels[i++] = original[r][c].g;
-        pixels[i++] = original[r][c].b;
-        pixels[i++] = original[r][c].a;
-      }
+  cout << "log-average luminance " << stats.logAverage() << ", brightest pixel " << stats.maxLuminance << endl;
+  applyCurve(reinhardCurve(stats, key, white));
+}
+
+//contrast the display can show, brightest over darkest luminance, for histogram adjustment
+#define DISPLAY_RANGE 100
+
+//histogram adjustment (Ward) tone mapping, which needs no parameters from the user. the
+//histogram of the shown level is close enough to the full one to build the curve from
+void wardToneMapping() {
+  Level &level = levels[shown];
+  if(level.luminance.empty()) {
+    measureLevel(level);
+  }
+  LogHistogram hist = histogramImage(&level.luminance[0], level.width, level.height);
+  applyCurve(wardCurve(hist, DISPLAY_RANGE));
+}
+
+//local (Durand and Dorsey) tone mapping. only the large scale contrast is compressed, so
+//interiors and skies keep their detail
+function<void(Level&)> durandOperator(float contrast) {
+  return [contrast](Level &level) {
+    //the base layer only depends on the image, so changing the contrast reuses it
+    size_t n = (size_t)level.width * level.height;
+    if(level.baseLayer.empty()) {
+      level.baseLayer.resize(n);
+      durandBaseLayer(&level.luminance[0], level.width, level.height, &level.baseLayer[0]);
     }
+    DurandCurve curve = durandCurve(&level.baseLayer[0], level.width, level.height, contrast);
+    renderRows(level, [&](const pixel* in, pixel* out, int r) {
+      size_t offset = (size_t)r * level.width;
+      durandToneMapRow(in, out, &level.luminance[offset], &level.baseLayer[offset], level.width, curve);
+    });
+  };
+}
+
+void durandToneMapping() {
+  applyOperator(durandOperator(promptValue("target contrast", 5)));
+}
+
+//handles the rendering of images to the viewport
+void renderImage(){
+  if(levels.empty())
+    return;
+  Level &level = levels[shown];
+  updateLevel(level);
+
+  //pixmaps are stored as one block of RGBA floats (or half floats), so they are drawn without a copy
+  const void* pixels;
+  GLenum type = GL_FLOAT;
+  if(level.halfOriginal) {
+    pixels = displayOriginal ? level.halfOriginal[0] : level.halfPixmap[0];
+    type = GL_HALF_FLOAT;
   }
   else {
-    for (int r = 0; r < height; r++) {
-      for (int c = 0; c < width; c++) {
-        pixels[i++] = pixmap[r][c].r;
-        pixels[i++] = pixmap[r][c].g;
-        pixels[i++] = pixmap[r][c].b;
-        pixels[i++] = pixmap[r][c].a;
-      }
-    }
+    pixels = displayOriginal ? level.original[0] : level.pixmap[0];
   }
 
   //clear the buffer
@@ -203,20 +468,27 @@ void renderImage(){
   //flip the image upright
   glPixelZoom(1, -1);
   //shift the image up
-  glRasterPos2d(0, height);
+  glRasterPos2d(0, level.height);
   //draw the image
-  glDrawPixels(width, height, GL_RGBA, GL_FLOAT, pixels);
+  glDrawPixels(level.width, level.height, GL_RGBA, type, pixels);
   //flush the buffer to the viewport
   glFlush();
   //resize window to fit image
-  glutReshapeWindow(width, height);
+  glutReshapeWindow(level.width, level.height);
+}
+
+//writes the full resolution image, mapping it first when only a smaller level has been shown. rows
+//are encoded straight from the pixmap as they are written, so no window is needed
+bool writeLevel(string filename) {
+  Level &full = levels[0];
+  updateLevel(full);
+  return writeRows(filename, full.width, full.height, 4, encoding, [&](int r, pixel* buffer) {
+    return displayRow(full, r, buffer);
+  });
 }
 
-//read the current image in the frame buffer and saves to the file given by the user
+//writes the image to the file given by the user
 void writeImage(){
-  int w = glutGet(GLUT_WINDOW_WIDTH);
-  int h = glutGet(GLUT_WINDOW_HEIGHT);
-  float pixels[4 * w * h];
   string outfilename;
 
   // get a filename for the image. The file suffix should indicate the image file
@@ -224,92 +496,7 @@ void writeImage(){
   cout << "enter output image filename: ";
   cin >> outfilename;
 
-  outfilename = outfilename + ".png";
-
-  // create the oiio file handler for the image
-  std::unique_ptr<ImageOutput> outfile = ImageOutput::create(outfilename);
-  if(!outfile){
-    cerr << "Could not create output image for " << outfilename << ", error = " << geterror() << endl;
-    return;
-  }
-  
-  // get the current pixels from the OpenGL framebuffer and store in pixmap
-  glReadPixels(0, 0, w, h, GL_RGBA, GL_FLOAT, pixels);
-
-  //flip image
-  //allocation for temp pixmap
-  pixel **temp = new pixel * [height];
-  temp[0] = new pixel[width * height];
-  for (int i = 1; i < height; i++) {
-    temp[i] = temp[i-1] + width;
-  }
-
-  //copy read pixels to temp
-  int i = 0;
-  for (int r = 0; r < height; r++) {
-    for (int c = 0; c < width; c++) {
-      temp[r][c].r = pixels[i++];
-      temp[r][c].g = pixels[i++];
-      temp[r][c].b = pixels[i++];
-      temp[r][c].a = pixels[i++];
-    }
-  }
-
-  //flip temp across x axis
-  float red, green, blue, alpha;
-  for(int r = 0; r < height / 2; r++) {
-    for(int c = 0; c < width; c++) {
-      red = temp[r][c].r;
-      green = temp[r][c].g;
-      blue = temp[r][c].b;
-      alpha = temp[r][c].a;
-
-      temp[r][c].r = temp[height - 1 - r][c].r;
-      temp[r][c].g = temp[height - 1 - r][c].g;
-      temp[r][c].b = temp[height - 1 - r][c].b;
-      temp[r][c].a = temp[height - 1 - r][c].a;
-
-      temp[height - 1 - r][c].r = red;
-      temp[height - 1 - r][c].g = green;
-      temp[height - 1 - r][c].b = blue;
-      temp[height - 1 - r][c].a = alpha;
-    }
-  }
-
-  //move flipped pixmap back into pixels
-  i = 0;
-  for (int r = 0; r < height; r++) {
-    for (int c = 0; c < width; c++) {
-      pixels[i++] = temp[r][c].r;
-      pixels[i++] = temp[r][c].g;
-      pixels[i++] = temp[r][c].b;
-      pixels[i++] = temp[r][c].a;
-    }
-  }
-
-  // open a file for writing the image. The file header will indicate an image of
-  // width w, height h, and 4 channels per pixel (RGBA). All channels will be of
-  // type float
-  ImageSpec spec(w, h, 4, TypeDesc::FLOAT);
-  if(!outfile->open(outfilename, spec)){
-    cerr << "Could not open " << outfilename << ", error = " << geterror() << endl;
-    return;
-  }
-
-  // write the image to the file. All channel values in the pixmap are taken to be
-  // unsigned chars
-  if(!outfile->write_image(TypeDesc::FLOAT, pixels)){
-    cerr << "Could not write image to " << outfilename << ", error = " << geterror() << endl;
-    return;
-  }
-  else
-    cout << "File saved" << endl;
-  
-  // close the image file after the image is written
-  if(!outfile->close()){
-    cerr << "Could not close " << outfilename << ", error = " << geterror() << endl;
-    return;
-  }
+  writeLevel(outfilename + ".png");
 }
 
 /*
@@ -322,7 +509,7 @@ void handleKey(unsigned char key, int x, int y){
   switch(key){     
     case 'r': // r - reset image
     case 'R':
-      resetImage();
+      applyOperator(nullptr);
       glutPostRedisplay();
       break;
 
@@ -344,6 +531,24 @@ void handleKey(unsigned char key, int x, int y){
       glutPostRedisplay();
       break;
 
+    case 'p': //p - apply photographic (Reinhard) tone mapping
+    case 'P':
+      reinhardToneMapping();
+      glutPostRedisplay();
+      break;
+
+    case 'h': //h - apply histogram adjustment (Ward) tone mapping
+    case 'H':
+      wardToneMapping();
+      glutPostRedisplay();
+      break;
+
+    case 'd': //d - apply local (Durand) tone mapping
+    case 'D':
+      durandToneMapping();
+      glutPostRedisplay();
+      break;
+
     case 't': //t - toggle between edited and unedited image
     case 'T':
       displayOriginal = !displayOriginal;
@@ -379,15 +584,101 @@ void handleReshape(int w, int h){
   glMatrixMode(GL_PROJECTION);
   glLoadIdentity();
   gluOrtho2D(0, w, 0, h);
+
+  //show the largest level that fits in the window
+  if(levels.empty())
+    return;
+  int fits = levels.size() - 1;
+  while(fits > 0 && levels[fits - 1].width <= w && levels[fits - 1].height <= h) {
+    fits--;
+  }
+  if(fits != shown) {
+    shown = fits;
+    glutPostRedisplay();
+  }
+}
+
+//prints the ways tonemap can be run and exits
+static void usage() {
+  cerr << "incorrect usage. correct usage is: \"./tonemap [-half] [-16] [-srgb] <filename>\", \"./tonemap [-half] [-16] [-srgb] -merge | -fuse <bracket> <bracket> ...\" or \"./tonemap [-half] [-16] [-srgb] <in> <out> [b | g gamma | p key white | h range | d contrast]\"" << endl;
+  exit(-1);
 }
 
 /*
    Main program to draw the square, change colors, and wait for quit
 */
 int main(int argc, char* argv[]){
-  if(argc != 2) {
-    cerr << "incorrect usage. correct usage is: \"./tonemap <filename>\"" << endl;
-    exit(-1);
+  //-half keeps the image in half floats, for images too large to hold as floats. -16 writes 16 bits
+  //per channel instead of 8, and -srgb encodes written values with the sRGB curve
+  //-merge takes the files after it as exposure brackets of one scene, merged into a radiance map to
+  //edit. -fuse blends them into a displayable image instead
+  bool sixteen = false;
+  Assembler assemble = NULL;
+  while(argc >= 2 && argv[1][0] == '-' && !assemble) {
+    string flag = argv[1];
+    if(flag == "-half")
+      halfMode = true;
+    else if(flag == "-merge")
+      assemble = mergeExposures;
+    else if(flag == "-fuse")
+      assemble = fuseExposures;
+    else if(flag == "-16")
+      sixteen = true;
+    else if(flag == "-srgb")
+      encoding.srgb = true;
+    else
+      break;
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+  //the window writes 16 bits unless asked, as it did when it wrote floats
+  encoding.bits = sixteen || argc == 2 || assemble ? 16 : 8;
+
+  //with an output file the image is tone mapped a strip at a time and written without a window
+  if(argc >= 3 && !assemble) {
+    ToneOperator op = REINHARD;
+    float param = 0.18, white = 0;
+    if(argc >= 4) {
+      switch(argv[3][0]) {
+        case 'b':
+          op = BASELINE;
+          break;
+        case 'g':
+          op = GAMMA;
+          param = argc >= 5 ? atof(argv[4]) : 1.0 / 2.2;
+          break;
+        case 'h':
+          op = WARD;
+          param = argc >= 5 ? atof(argv[4]) : DISPLAY_RANGE;
+          //the display range is a ratio of brightest to darkest, so it must be more than 1
+          if(!(param > 1))
+            usage();
+          break;
+        case 'p':
+          op = REINHARD;
+          param = argc >= 5 ? atof(argv[4]) : 0.18;
+          white = argc >= 6 ? atof(argv[5]) : 0;
+          break;
+        case 'd':
+          //local tone mapping needs the whole image, so it is read into memory and written from there
+          readImage(argv[1]);
+          if(levels.empty()) {
+            cerr << "Could not open " << argv[1] << ", error = " << geterror() << endl;
+            exit(-1);
+          }
+          current = durandOperator(argc >= 5 ? atof(argv[4]) : 5);
+          return writeLevel(argv[2]) ? 0 : -1;
+        default:
+          cerr << "unknown operator " << argv[3] << endl;
+          exit(-1);
+      }
+    }
+    return streamToneMap(argv[1], argv[2], op, param, white, encoding) ? 0 : -1;
+  }
+
+  if(assemble ? argc < 3 : argc != 2) {
+    usage();
   }
 
   // start up the glut utilities
@@ -404,8 +695,17 @@ int main(int argc, char* argv[]){
   glutKeyboardFunc(handleKey);	  // keyboard callback
   glutReshapeFunc(handleReshape); // window resize callback
 
-  if(argc == 2) {
+  if(assemble) {
+    assembleImage(vector<string>(argv + 1, argv + argc), assemble);
+  }
+  else {
     readImage(argv[1]);
+  }
+  if(!levels.empty()) {
+    //large images are edited on a level that fits on the screen
+    int screenWidth = glutGet(GLUT_SCREEN_WIDTH);
+    int screenHeight = glutGet(GLUT_SCREEN_HEIGHT);
+    buildPyramid(screenWidth > 0 ? screenWidth : width, screenHeight > 0 ? screenHeight : height);
     renderImage();
   }
   
@@ -0,0 +1,102 @@
+// writer.cpp
+// Ryan Painter CPSC 4040
+// Writes float pixmaps to 8 or 16 bit files, encoding a strip of rows at a time.
+
+#include "writer.h"
+#include "fastmath.h"
+#include "parallel.h"
+
+#include <OpenImageIO/imageio.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace std;
+OIIO_NAMESPACE_USING
+
+//values per block passed through the vectorized power function
+#define BLOCK 1024
+
+//rows per strip handed to the file writer
+#define WRITE_STRIP 64
+
+template <typename T>
+static void encodeValues(const pixel* in, int n, int channels, bool srgb, float levels, T* out) {
+  float value[BLOCK], curve[BLOCK];
+  int pixelsPerBlock = BLOCK / channels;
+
+  for (int start = 0; start < n; start += pixelsPerBlock) {
+    int count = n - start < pixelsPerBlock ? n - start : pixelsPerBlock;
+    int values = count * channels;
+
+    //gather and clamp the channels of the block. NaN fails every compare, so it is written as 0
+    //rather than reaching the integer cast
+    const float* src = &in[start].r;
+    for (int p = 0, i = 0; p < count; p++, src += 4) {
+      for (int c = 0; c < channels; c++, i++) {
+        float v = src[c];
+        value[i] = !(v > 0) ? 0 : (v > 1 ? 1 : v);
+      }
+    }
+
+    //sRGB: linear below 0.0031308, 1.055 v^(1 / 2.4) - 0.055 above
+    if(srgb) {
+      fastPowRow(value, values, 1 / 2.4f, curve);
+      for (int i = 0; i < values; i++) {
+        value[i] = value[i] <= 0.0031308f ? 12.92f * value[i] : 1.055f * curve[i] - 0.055f;
+      }
+    }
+
+    T* dst = out + (size_t)start * channels;
+    for (int i = 0; i < values; i++) {
+      dst[i] = (T)(value[i] * levels + 0.5f);
+    }
+  }
+}
+
+void encodeRow(const pixel* in, int n, int channels, Encoding encoding, void* out) {
+  if(encoding.bits == 16)
+    encodeValues(in, n, channels, encoding.srgb, 65535.0f, (unsigned short*)out);
+  else
+    encodeValues(in, n, channels, encoding.srgb, 255.0f, (unsigned char*)out);
+}
+
+bool writeRows(string filename, int width, int height, int channels, Encoding encoding,
+               function<const pixel*(int, pixel*)> row) {
+  std::unique_ptr<ImageOutput> out = ImageOutput::create(filename);
+  if(!out) {
+    cerr << "Could not create output image for " << filename << ", error = " << geterror() << endl;
+    return false;
+  }
+
+  TypeDesc type = encoding.bits == 16 ? TypeDesc::UINT16 : TypeDesc::UINT8;
+  ImageSpec spec(width, height, channels, type);
+  if(!out->open(filename, spec)) {
+    cerr << "Could not open " << filename << ", error = " << out->geterror() << endl;
+    return false;
+  }
+
+  size_t rowBytes = (size_t)width * channels * type.size();
+  vector<unsigned char> strip(rowBytes * WRITE_STRIP);
+  for (int y = 0; y < height; y += WRITE_STRIP) {
+    int rows = min(WRITE_STRIP, height - y);
+    parallelRows(rows, [&](int rowBegin, int rowEnd) {
+      vector<pixel> buffer(width);
+      for (int r = rowBegin; r < rowEnd; r++) {
+        encodeRow(row(y + r, &buffer[0]), width, channels, encoding, &strip[r * rowBytes]);
+      }
+    });
+
+    if(!out->write_scanlines(y, y + rows, 0, type, &strip[0])) {
+      cerr << "Could not write image to " << filename << ", error = " << out->geterror() << endl;
+      return false;
+    }
+  }
+
+  if(!out->close()) {
+    cerr << "Could not close " << filename << ", error = " << out->geterror() << endl;
+    return false;
+  }
+  cout << "File saved" << endl;
+  return true;
+}
@@ -0,0 +1,29 @@
+// writer.h
+// Ryan Painter CPSC 4040
+// Writes float pixmaps to 8 or 16 bit files, encoding a strip of rows at a time.
+
+#ifndef _WRITER_INCLUDED_
+#define _WRITER_INCLUDED_
+
+#include "operators.h"
+
+#include <functional>
+#include <string>
+
+//how float values are stored in the file
+struct Encoding {
+  int bits;   //8 or 16 bits per channel
+  bool srgb;  //apply the sRGB transfer curve, otherwise values are stored linearly
+};
+
+//encodes n pixels into out, channels (3 or 4) values per pixel of 1 or 2 bytes each. values are
+//clamped to 0 - 1, passed through the sRGB curve if asked and rounded to the nearest level
+void encodeRow(const pixel* in, int n, int channels, Encoding encoding, void* out);
+
+//writes a width x height image top row first. row(r, buffer) returns row r of the image, either
+//its own storage or buffer filled with width pixels. rows are fetched, encoded and written a strip
+//at a time, so no full size copy of the image is made
+bool writeRows(std::string filename, int width, int height, int channels, Encoding encoding,
+               std::function<const pixel*(int, pixel*)> row);
+
+#endif
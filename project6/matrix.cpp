@@ -6,6 +6,10 @@
 
 #include "matrix.h"
 
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 using namespace std;
 
 Matrix3D::Matrix3D(){
@@ -17,7 +21,7 @@ Matrix3D::Matrix3D(const double coefs[3][3]){
 }
 
 Matrix3D::Matrix3D(const Matrix3D &mat){
-  set(mat.M);
+  M = mat.M;
 }
 
 /*
@@ -36,11 +40,7 @@ void Matrix3D::print()const{
    Set the matrix m to the indentity matrix
 */
 void Matrix3D::setidentity(){
-
-  M[0][0] = M[1][1] = M[2][2] = 1.0;
-  M[0][1] = M[0][2] = 0.0;
-  M[1][0] = M[1][2] = 0.0;
-  M[2][0] = M[2][1] = 0.0;
+  M = Mat3d();
 }
 
 /*
@@ -57,16 +57,7 @@ void Matrix3D::set(const double coefs[3][3]){
    Function to compute and return the determinant of the 3x3 matrix m.
 */
 double Matrix3D::determinant()const{
-  double det;
-
-  det  = M[0][0] * M[1][1] * M[2][2];
-  det += M[0][1] * M[1][2] * M[2][0];
-  det += M[0][2] * M[2][1] * M[1][0];
-  det -= M[2][0] * M[1][1] * M[0][2];
-  det -= M[1][0] * M[0][1] * M[2][2];
-  det -= M[0][0] * M[1][2] * M[2][1];
-
-  return det;
+  return ::determinant(M);
 }
 
 /*
@@ -74,19 +65,7 @@ double Matrix3D::determinant()const{
    matrix adj.
 */
 Matrix3D Matrix3D::adjoint()const{
-  Matrix3D adj;
-  
-  adj.M[0][0] = (M[1][1] * M[2][2] - M[1][2] * M[2][1]);
-  adj.M[0][1] = (M[0][2] * M[2][1] - M[0][1] * M[2][2]);
-  adj.M[0][2] = (M[0][1] * M[1][2] - M[0][2] * M[1][1]);
-  adj.M[1][0] = (M[1][2] * M[2][0] - M[1][0] * M[2][2]);
-  adj.M[1][1] = (M[0][0] * M[2][2] - M[0][2] * M[2][0]);
-  adj.M[1][2] = (M[0][2] * M[1][0] - M[0][0] * M[1][2]);
-  adj.M[2][0] = (M[1][0] * M[2][1] - M[1][1] * M[2][0]);
-  adj.M[2][1] = (M[0][1] * M[2][0] - M[0][0] * M[2][1]);
-  adj.M[2][2] = (M[0][0] * M[1][1] - M[0][1] * M[1][0]);
-  
-  return adj;
+  return ::adjoint(M);
 }
 
 /*
@@ -94,20 +73,7 @@ Matrix3D Matrix3D::adjoint()const{
    matrix inv.
 */
 Matrix3D Matrix3D::inverse()const{
-  Matrix3D inv;  
-  double det = determinant();
-
-  inv.M[0][0] = (M[1][1] * M[2][2] - M[1][2] * M[2][1]) / det;
-  inv.M[0][1] = (M[0][2] * M[2][1] - M[0][1] * M[2][2]) / det;
-  inv.M[0][2] = (M[0][1] * M[1][2] - M[0][2] * M[1][1]) / det;
-  inv.M[1][0] = (M[1][2] * M[2][0] - M[1][0] * M[2][2]) / det;
-  inv.M[1][1] = (M[0][0] * M[2][2] - M[0][2] * M[2][0]) / det;
-  inv.M[1][2] = (M[0][2] * M[1][0] - M[0][0] * M[1][2]) / det;
-  inv.M[2][0] = (M[1][0] * M[2][1] - M[1][1] * M[2][0]) / det;
-  inv.M[2][1] = (M[0][1] * M[2][0] - M[0][0] * M[2][1]) / det;
-  inv.M[2][2] = (M[0][0] * M[1][1] - M[0][1] * M[1][0]) / det;
-  
-  return inv;
+  return ::inverse(M);
 }
 
 /*
@@ -116,26 +82,16 @@ Matrix3D Matrix3D::inverse()const{
  2) multiply m by this 3D vector
 */
 Vector3D Matrix3D::operator*(const Vector2D &v)const{
-  Vector3D vout;
-  
-  vout.x =  M[0][0] * v.x + M[0][1] * v.y + M[0][2];
-  vout.y =  M[1][0] * v.x + M[1][1] * v.y + M[1][2];
-  vout.z =  M[2][0] * v.x + M[2][1] * v.y + M[2][2];
-  
-  return vout;
+  Vec3d h = M * Vec2d(v.x, v.y);
+  return Vector3D(h[0], h[1], h[2]);
 }
 
 /*
  Multiply the 3x3 matrix m by the 3D vector v
  */
 Vector3D Matrix3D::operator*(const Vector3D &v)const{
-  Vector3D vout;
-  
-  vout.x =  M[0][0] * v.x + M[0][1] * v.y + M[0][2] * v.z;
-  vout.y =  M[1][0] * v.x + M[1][1] * v.y + M[1][2] * v.z;
-  vout.z =  M[2][0] * v.x + M[2][1] * v.y + M[2][2] * v.z;
-  
-  return vout;
+  Vec3d h = M * Vec3d(v.x, v.y, v.z);
+  return Vector3D(h[0], h[1], h[2]);
 }
 
 /*
@@ -143,23 +99,15 @@ Vector3D Matrix3D::operator*(const Vector3D &v)const{
  3x3 matrix m3.  I.e. m3 = m1 * m2
  */
 Matrix3D Matrix3D::operator*(const Matrix3D &m2)const{
-  double sum;
-  int row, col, rc;
-  Matrix3D prod;	/* make internal copy in case m3 is m1 or m2 */
-  
-  for(row = 0; row < 3; row++)
-    for(col = 0; col < 3; col++){
-      sum = 0.0;
-      for(rc = 0; rc < 3; rc++)
-		sum += M[row][rc] * m2.M[rc][col];
-      prod.M[row][col] = sum;
-    }
-  
-  return prod;
+  return M * m2.M;
 }
 
 double *Matrix3D::operator[](int i){
-  return (double *)&(M[i]);
+  return M[i].v;
+}
+
+const double *Matrix3D::operator[](int i)const{
+  return M[i].v;
 }
 
 void setbilinear(double width, double height, Vector2D xycorners[4],
@@ -180,6 +128,16 @@ void setbilinear(double width, double height, Vector2D xycorners[4],
   coeff.c2 = coeff.a3 * coeff.b2 - coeff.a2 * coeff.b3;
 }
 
+/*
+   u of a point (dx, dy) from the corner a0, b0, given its v. Either of the two
+   equations of the bilinear map gives it; the one with the larger denominator
+   is taken, as the other is 0 where an edge of the quad is vertical or horizontal.
+*/
+static inline double solveu(const BilinearCoeffs &c, double dx, double dy, double v){
+  double ex = c.a1 + c.a3 * v, ey = c.b1 + c.b3 * v;
+  return fabs(ex) >= fabs(ey) ? (dx - c.a2 * v) / ex : (dy - c.b2 * v) / ey;
+}
+
 /*
    Compute the inverse bilinear transform of the point xy, back
    into the unit normalized source space uv, using the coefficient block c.
@@ -191,9 +149,11 @@ void invbilinear(const BilinearCoeffs &c, Vector2D xy, Vector2D &uv){
   static double EPSILON = 1.0e-5;
 
   if(fabs(c.c2) <= EPSILON){
-    uv.y = (c.a1 * xy.y - c.a1 * c.b0 - c.b1 * xy.x + c.a0 * c.b1) /
-      (c.a1 * c.b2 - c.a2 * c.b1);
-    uv.x = (xy.x - c.a0 - c.a2 * uv.y) / c.a1;
+    // a parallelogram, solved by Cramer's rule
+    double det = c.a1 * c.b2 - c.a2 * c.b1;
+    double dx = xy.x - c.a0, dy = xy.y - c.b0;
+    uv.x = (dx * c.b2 - c.a2 * dy) / det;
+    uv.y = (c.a1 * dy - c.b1 * dx) / det;
   }
   else{
     c0 = c.a1 * (c.b0 - xy.y) + c.b1 * (xy.x - c.a0);
@@ -202,19 +162,17 @@ void invbilinear(const BilinearCoeffs &c, Vector2D xy, Vector2D &uv){
     
     discriminant = sqrt(c1 * c1 - 4.0 * c.c2 * c0);
     
+    double dx = xy.x - c.a0, dy = xy.y - c.b0;
     uv.y =(-c1 + discriminant) / (2.0 * c.c2);
     if(uv.y < 0.0 || uv.y > 1.0){
       uv.y =(-c1 - discriminant) / (2.0 * c.c2);
-      uv.x =
-	(xy.x - c.a0 - c.a2 * uv.y) / (c.a1 + c.a3 * uv.y);
+      uv.x = solveu(c, dx, dy, uv.y);
     }
     else{
-      uv.x =
-	(xy.x - c.a0 - c.a2 * uv.y) / (c.a1 + c.a3 * uv.y);
+      uv.x = solveu(c, dx, dy, uv.y);
       if(uv.x < 0.0 || uv.x > 1.0){
 	uv.y =(-c1 - discriminant) / (2.0 * c.c2);
-	uv.x =
-	  (xy.x - c.a0 - c.a2 * uv.y) / (c.a1 + c.a3 * uv.y);
+	uv.x = solveu(c, dx, dy, uv.y);
       }
     }
   }
@@ -222,3 +180,97 @@ void invbilinear(const BilinearCoeffs &c, Vector2D xy, Vector2D &uv){
   uv.x *= c.width;
   uv.y *= c.height;
 }
+
+void invbilinear(const BilinearCoeffs &c, const double *x, const double *y, int n,
+		 double *u, double *v){
+  static double EPSILON = 1.0e-5;
+  int i = 0;
+
+  // a parallelogram maps linearly, which is decided once for all the points
+  if(fabs(c.c2) <= EPSILON){
+    double det = c.a1 * c.b2 - c.a2 * c.b1;
+    for(; i < n; i++){
+      double dx = x[i] - c.a0, dy = y[i] - c.b0;
+      u[i] = (dx * c.b2 - c.a2 * dy) / det * c.width;
+      v[i] = (c.a1 * dy - c.b1 * dx) / det * c.height;
+    }
+    return;
+  }
+
+  double k = c.a1 * c.b2 - c.a2 * c.b1;
+  double half = 0.5 / c.c2;
+
+  // each lane takes the + root when it and its u are in [0, 1], otherwise the - root,
+  // so a NaN root, whose compares are all false, falls through to the other one. u is
+  // solved from whichever equation has the larger denominator, as solveu does
+#if defined(__AVX__)
+  __m256d a0 = _mm256_set1_pd(c.a0), a1 = _mm256_set1_pd(c.a1), a2 = _mm256_set1_pd(c.a2), a3 = _mm256_set1_pd(c.a3);
+  __m256d b0 = _mm256_set1_pd(c.b0), b1 = _mm256_set1_pd(c.b1), b2 = _mm256_set1_pd(c.b2), b3 = _mm256_set1_pd(c.b3);
+  __m256d sign = _mm256_set1_pd(-0.0);
+  __m256d kk = _mm256_set1_pd(k), c2x4 = _mm256_set1_pd(4.0 * c.c2), h = _mm256_set1_pd(half);
+  __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+  __m256d w = _mm256_set1_pd(c.width), ht = _mm256_set1_pd(c.height);
+  for(; i + 4 <= n; i += 4){
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), a0);
+    __m256d dy = _mm256_sub_pd(b0, _mm256_loadu_pd(y + i));
+    __m256d c0 = _mm256_add_pd(_mm256_mul_pd(a1, dy), _mm256_mul_pd(b1, dx));
+    __m256d c1 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a3, dy), _mm256_mul_pd(b3, dx)), kk);
+    __m256d d = _mm256_sqrt_pd(_mm256_sub_pd(_mm256_mul_pd(c1, c1), _mm256_mul_pd(c2x4, c0)));
+    __m256d v1 = _mm256_mul_pd(_mm256_sub_pd(d, c1), h);
+    __m256d v2 = _mm256_mul_pd(_mm256_sub_pd(_mm256_setzero_pd(), _mm256_add_pd(c1, d)), h);
+    __m256d ex1 = _mm256_add_pd(a1, _mm256_mul_pd(a3, v1)), ey1 = _mm256_add_pd(b1, _mm256_mul_pd(b3, v1));
+    __m256d ex2 = _mm256_add_pd(a1, _mm256_mul_pd(a3, v2)), ey2 = _mm256_add_pd(b1, _mm256_mul_pd(b3, v2));
+    __m256d x1 = _mm256_cmp_pd(_mm256_andnot_pd(sign, ex1), _mm256_andnot_pd(sign, ey1), _CMP_GE_OQ);
+    __m256d x2 = _mm256_cmp_pd(_mm256_andnot_pd(sign, ex2), _mm256_andnot_pd(sign, ey2), _CMP_GE_OQ);
+    __m256d ny = _mm256_sub_pd(zero, dy);
+    __m256d u1 = _mm256_div_pd(_mm256_blendv_pd(_mm256_sub_pd(ny, _mm256_mul_pd(b2, v1)), _mm256_sub_pd(dx, _mm256_mul_pd(a2, v1)), x1),
+                               _mm256_blendv_pd(ey1, ex1, x1));
+    __m256d u2 = _mm256_div_pd(_mm256_blendv_pd(_mm256_sub_pd(ny, _mm256_mul_pd(b2, v2)), _mm256_sub_pd(dx, _mm256_mul_pd(a2, v2)), x2),
+                               _mm256_blendv_pd(ey2, ex2, x2));
+    __m256d ok = _mm256_and_pd(_mm256_and_pd(_mm256_cmp_pd(v1, zero, _CMP_GE_OQ), _mm256_cmp_pd(v1, one, _CMP_LE_OQ)),
+                               _mm256_and_pd(_mm256_cmp_pd(u1, zero, _CMP_GE_OQ), _mm256_cmp_pd(u1, one, _CMP_LE_OQ)));
+    _mm256_storeu_pd(u + i, _mm256_mul_pd(_mm256_blendv_pd(u2, u1, ok), w));
+    _mm256_storeu_pd(v + i, _mm256_mul_pd(_mm256_blendv_pd(v2, v1, ok), ht));
+  }
+#elif defined(__SSE2__)
+  __m128d a0 = _mm_set1_pd(c.a0), a1 = _mm_set1_pd(c.a1), a2 = _mm_set1_pd(c.a2), a3 = _mm_set1_pd(c.a3);
+  __m128d b0 = _mm_set1_pd(c.b0), b1 = _mm_set1_pd(c.b1), b2 = _mm_set1_pd(c.b2), b3 = _mm_set1_pd(c.b3);
+  __m128d sign = _mm_set1_pd(-0.0);
+  __m128d kk = _mm_set1_pd(k), c2x4 = _mm_set1_pd(4.0 * c.c2), h = _mm_set1_pd(half);
+  __m128d zero = _mm_setzero_pd(), one = _mm_set1_pd(1.0);
+  __m128d w = _mm_set1_pd(c.width), ht = _mm_set1_pd(c.height);
+  for(; i + 2 <= n; i += 2){
+    __m128d dx = _mm_sub_pd(_mm_loadu_pd(x + i), a0);
+    __m128d dy = _mm_sub_pd(b0, _mm_loadu_pd(y + i));
+    __m128d c0 = _mm_add_pd(_mm_mul_pd(a1, dy), _mm_mul_pd(b1, dx));
+    __m128d c1 = _mm_add_pd(_mm_add_pd(_mm_mul_pd(a3, dy), _mm_mul_pd(b3, dx)), kk);
+    __m128d d = _mm_sqrt_pd(_mm_sub_pd(_mm_mul_pd(c1, c1), _mm_mul_pd(c2x4, c0)));
+    __m128d v1 = _mm_mul_pd(_mm_sub_pd(d, c1), h);
+    __m128d v2 = _mm_mul_pd(_mm_sub_pd(zero, _mm_add_pd(c1, d)), h);
+    __m128d ex1 = _mm_add_pd(a1, _mm_mul_pd(a3, v1)), ey1 = _mm_add_pd(b1, _mm_mul_pd(b3, v1));
+    __m128d ex2 = _mm_add_pd(a1, _mm_mul_pd(a3, v2)), ey2 = _mm_add_pd(b1, _mm_mul_pd(b3, v2));
+    __m128d x1 = _mm_cmpge_pd(_mm_andnot_pd(sign, ex1), _mm_andnot_pd(sign, ey1));
+    __m128d x2 = _mm_cmpge_pd(_mm_andnot_pd(sign, ex2), _mm_andnot_pd(sign, ey2));
+    __m128d ny = _mm_sub_pd(zero, dy);
+    __m128d u1 = _mm_div_pd(_mm_or_pd(_mm_and_pd(x1, _mm_sub_pd(dx, _mm_mul_pd(a2, v1))), _mm_andnot_pd(x1, _mm_sub_pd(ny, _mm_mul_pd(b2, v1)))),
+                            _mm_or_pd(_mm_and_pd(x1, ex1), _mm_andnot_pd(x1, ey1)));
+    __m128d u2 = _mm_div_pd(_mm_or_pd(_mm_and_pd(x2, _mm_sub_pd(dx, _mm_mul_pd(a2, v2))), _mm_andnot_pd(x2, _mm_sub_pd(ny, _mm_mul_pd(b2, v2)))),
+                            _mm_or_pd(_mm_and_pd(x2, ex2), _mm_andnot_pd(x2, ey2)));
+    __m128d ok = _mm_and_pd(_mm_and_pd(_mm_cmpge_pd(v1, zero), _mm_cmple_pd(v1, one)),
+                            _mm_and_pd(_mm_cmpge_pd(u1, zero), _mm_cmple_pd(u1, one)));
+    _mm_storeu_pd(u + i, _mm_mul_pd(_mm_or_pd(_mm_and_pd(ok, u1), _mm_andnot_pd(ok, u2)), w));
+    _mm_storeu_pd(v + i, _mm_mul_pd(_mm_or_pd(_mm_and_pd(ok, v1), _mm_andnot_pd(ok, v2)), ht));
+  }
+#endif
+  for(; i < n; i++){
+    double dx = x[i] - c.a0, dy = c.b0 - y[i];
+    double c0 = c.a1 * dy + c.b1 * dx;
+    double c1 = c.a3 * dy + c.b3 * dx + k;
+    double d = sqrt(c1 * c1 - 4.0 * c.c2 * c0);
+    double v1 = (d - c1) * half, v2 = -(c1 + d) * half;
+    double u1 = solveu(c, dx, -dy, v1), u2 = solveu(c, dx, -dy, v2);
+    bool ok = v1 >= 0.0 && v1 <= 1.0 && u1 >= 0.0 && u1 <= 1.0;
+    u[i] = (ok ? u1 : u2) * c.width;
+    v[i] = (ok ? v1 : v2) * c.height;
+  }
+}
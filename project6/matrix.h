@@ -4,9 +4,14 @@
 *   The code is based on previous code from D. House
 */
 
+#ifndef _MATRIX_INCLUDED_
+#define _MATRIX_INCLUDED_
+
 #include <cstdio>
 #include <cmath>
 
+#include "mat.h"
+
 #ifndef PI
 #define PI		3.1415926536
 #endif
@@ -23,14 +28,21 @@ struct Vector2D{
   Vector2D(double x_, double y_): x(x_), y(y_) {}
 };
 
+/*
+  3x3 transformation matrix of doubles, kept for the code written against it. It holds
+  a Mat3d (mat.h), which the loops that map many points use directly.
+*/
 class Matrix3D{
 private:
-  double M[3][3];
+  Mat3d M;
   
 public:
   Matrix3D();
   Matrix3D(const double coefs[3][3]);
   Matrix3D(const Matrix3D &mat);
+  Matrix3D(const Mat3d &mat): M(mat) {}
+
+  const Mat3d &mat() const { return M; }
 
   void print() const;
 
@@ -45,6 +57,7 @@ public:
   Vector3D operator*(const Vector3D &v) const;
   Matrix3D operator*(const Matrix3D &m2) const;
   double *operator[](int i);
+  const double *operator[](int i) const;
 };
 
 struct BilinearCoeffs{
@@ -57,3 +70,13 @@ struct BilinearCoeffs{
 void setbilinear(double width, double height,
 		 Vector2D xycorners[4], BilinearCoeffs &coeff);
 void invbilinear(const BilinearCoeffs &c, Vector2D xy, Vector2D &uv);
+
+/*
+  invbilinear for n points at once, (x[i], y[i]) to (u[i], v[i]). The root is picked
+  as in the single point version, but with masks rather than branches, several points
+  to a vector. Points with no root in the unit square come out of range or NaN.
+*/
+void invbilinear(const BilinearCoeffs &c, const double *x, const double *y, int n,
+		 double *u, double *v);
+
+#endif
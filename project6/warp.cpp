@@ -0,0 +1,1362 @@
+//Ryan Painter
+//rapaint
+
+/*
+ * Inverse mapping of pixmaps through a Matrix3D, a scanline at a time.
+ */
+
+#include "warp.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#if defined(__AVX__)
+#  include <immintrin.h>
+#elif defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// output pixels whose source coordinates are worked out together before they are copied
+#define WARP_BLOCK 256
+
+// output is warped in tiles this many rows tall, and at least this wide, so the part of the source
+// a thread reads stays cached
+#define WARP_TILE 64
+
+// source rows one row of a tile may cross before the tile is made narrower
+#define TILE_CROSSING 128
+
+// pixel map terms that move no source point across the output by more than this many pixels are
+// dropped or rounded. it is far above the rounding left by rotate() and the matrix inverse
+#define SNAP 1e-6
+
+// source pixels a tile may prefetch, as a multiple of its own pixels. past that the warp is shrinking
+// the source and its footprint would not stay in cache anyway
+#define PREFETCH_RATIO 4
+
+// reconstruction kernels are tabulated at this many points per pixel of distance
+#define KERNEL_STEPS 256
+
+// filtering rounds the position of a sample between pixels to this many phases per pixel, each
+// with its own set of tap weights, which is below a tenth of a level of error for 8 bit pixels
+#define KERNEL_PHASES 1024
+
+// fraction bits of the fixed point tap weights that pairs of pixels are filtered with
+#define WEIGHT_BITS 14
+
+// widest kernel radius, Lanczos-3's
+#define MAX_RADIUS 3
+
+// columns of an image transposed together, a strip at a time
+#define TRANSPOSE_STRIP 8
+
+/*
+ A scanline of the output as the per-pixel loop warpImage replaced saw it: output pixel x maps to
+ the homogeneous point inv * (x + left, y + bottom, 1), and its source pixel is that point's x and y
+ divided by its z, truncated. Every pixel is evaluated with the same operations in the same order as
+ that loop, so the truncation picks the same pixel even where the point falls exactly on a pixel
+ edge, which stepping the point from pixel to pixel would not. Only the products with y + bottom,
+ the same for the whole scanline, are shared.
+*/
+struct Scanline{
+  Vec3d a;      // the first column of the inverse, multiplied by x + left
+  Vec3d b;      // the second column, multiplied by y + bottom
+  Vec3d c;      // the third column
+  double left;
+
+  Scanline(const Mat3d &inv, double left, double y) :
+    a(inv.column(0)), b(inv.column(1) * y), c(inv.column(2)), left(left) {}
+
+  // the homogeneous source point of pixel x
+  Vec3d point(int x) const {
+    double X = x + left;
+    return Vec3d(a[0] * X + b[0] + c[0], a[1] * X + b[1] + c[1], a[2] * X + b[2] + c[2]);
+  }
+};
+
+/*
+ Fills u and v with the source pixel of pixels [x, x + n) of a scanline, four (AVX) or two (SSE2)
+ pixels at a time.
+*/
+static void spanCoordinates(const Scanline &s, int x, int n, int *u, int *v){
+  int i = 0;
+#if defined(__AVX__)
+  __m256d column = _mm256_set_pd(x + 3, x + 2, x + 1, x), four = _mm256_set1_pd(4), left = _mm256_set1_pd(s.left);
+  __m256d ax = _mm256_set1_pd(s.a[0]), ay = _mm256_set1_pd(s.a[1]), az = _mm256_set1_pd(s.a[2]);
+  __m256d bx = _mm256_set1_pd(s.b[0]), by = _mm256_set1_pd(s.b[1]), bz = _mm256_set1_pd(s.b[2]);
+  __m256d cx = _mm256_set1_pd(s.c[0]), cy = _mm256_set1_pd(s.c[1]), cz = _mm256_set1_pd(s.c[2]);
+  for(; i + 4 <= n; i += 4){
+    __m256d X = _mm256_add_pd(column, left);
+    __m256d hx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ax, X), bx), cx);
+    __m256d hy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ay, X), by), cy);
+    __m256d hz = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(az, X), bz), cz);
+    _mm_storeu_si128((__m128i *)(u + i), _mm256_cvttpd_epi32(_mm256_div_pd(hx, hz)));
+    _mm_storeu_si128((__m128i *)(v + i), _mm256_cvttpd_epi32(_mm256_div_pd(hy, hz)));
+    column = _mm256_add_pd(column, four);
+  }
+#elif defined(__SSE2__)
+  __m128d column = _mm_set_pd(x + 1, x), two = _mm_set1_pd(2), left = _mm_set1_pd(s.left);
+  __m128d ax = _mm_set1_pd(s.a[0]), ay = _mm_set1_pd(s.a[1]), az = _mm_set1_pd(s.a[2]);
+  __m128d bx = _mm_set1_pd(s.b[0]), by = _mm_set1_pd(s.b[1]), bz = _mm_set1_pd(s.b[2]);
+  __m128d cx = _mm_set1_pd(s.c[0]), cy = _mm_set1_pd(s.c[1]), cz = _mm_set1_pd(s.c[2]);
+  for(; i + 2 <= n; i += 2){
+    __m128d X = _mm_add_pd(column, left);
+    __m128d hx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, X), bx), cx);
+    __m128d hy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ay, X), by), cy);
+    __m128d hz = _mm_add_pd(_mm_add_pd(_mm_mul_pd(az, X), bz), cz);
+    _mm_storel_epi64((__m128i *)(u + i), _mm_cvttpd_epi32(_mm_div_pd(hx, hz)));
+    _mm_storel_epi64((__m128i *)(v + i), _mm_cvttpd_epi32(_mm_div_pd(hy, hz)));
+    column = _mm_add_pd(column, two);
+  }
+#endif
+  for(; i < n; i++){
+    Vec3d h = s.point(x + i);
+    u[i] = h[0] / h[2];
+    v[i] = h[1] / h[2];
+  }
+}
+
+/*
+ spanCoordinates for a scanline whose hz does not depend on x, the first column's z being 0. hz is
+ worked out once, and when it is 1, as it is for any affine matrix, nothing is divided at all.
+*/
+static void affineCoordinates(const Scanline &s, int x, int n, int *u, int *v){
+  double hz = s.point(x)[2];
+  int i = 0;
+#if defined(__AVX__)
+  __m256d column = _mm256_set_pd(x + 3, x + 2, x + 1, x), four = _mm256_set1_pd(4), left = _mm256_set1_pd(s.left);
+  __m256d ax = _mm256_set1_pd(s.a[0]), ay = _mm256_set1_pd(s.a[1]);
+  __m256d bx = _mm256_set1_pd(s.b[0]), by = _mm256_set1_pd(s.b[1]);
+  __m256d cx = _mm256_set1_pd(s.c[0]), cy = _mm256_set1_pd(s.c[1]);
+  __m256d z = _mm256_set1_pd(hz);
+  for(; i + 4 <= n; i += 4){
+    __m256d X = _mm256_add_pd(column, left);
+    __m256d hx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ax, X), bx), cx);
+    __m256d hy = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(ay, X), by), cy);
+    if(hz != 1){
+      hx = _mm256_div_pd(hx, z);
+      hy = _mm256_div_pd(hy, z);
+    }
+    _mm_storeu_si128((__m128i *)(u + i), _mm256_cvttpd_epi32(hx));
+    _mm_storeu_si128((__m128i *)(v + i), _mm256_cvttpd_epi32(hy));
+    column = _mm256_add_pd(column, four);
+  }
+#elif defined(__SSE2__)
+  __m128d column = _mm_set_pd(x + 1, x), two = _mm_set1_pd(2), left = _mm_set1_pd(s.left);
+  __m128d ax = _mm_set1_pd(s.a[0]), ay = _mm_set1_pd(s.a[1]);
+  __m128d bx = _mm_set1_pd(s.b[0]), by = _mm_set1_pd(s.b[1]);
+  __m128d cx = _mm_set1_pd(s.c[0]), cy = _mm_set1_pd(s.c[1]);
+  __m128d z = _mm_set1_pd(hz);
+  for(; i + 2 <= n; i += 2){
+    __m128d X = _mm_add_pd(column, left);
+    __m128d hx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ax, X), bx), cx);
+    __m128d hy = _mm_add_pd(_mm_add_pd(_mm_mul_pd(ay, X), by), cy);
+    if(hz != 1){
+      hx = _mm_div_pd(hx, z);
+      hy = _mm_div_pd(hy, z);
+    }
+    _mm_storel_epi64((__m128i *)(u + i), _mm_cvttpd_epi32(hx));
+    _mm_storel_epi64((__m128i *)(v + i), _mm_cvttpd_epi32(hy));
+    column = _mm_add_pd(column, two);
+  }
+#endif
+  for(; i < n; i++){
+    Vec3d h = s.point(x + i);
+    u[i] = h[0] / hz;
+    v[i] = h[1] / hz;
+  }
+}
+
+/*
+ Fills su and sv with the position in the source of n output pixels along a scanline, and rz with
+ 1 / hz for each. h is the homogeneous source point of the first and d the step from one pixel
+ to the next, and lanes of pixels are stepped together by several deltas. The filters weigh their
+ taps by the position, so they have no pixel edge to land on and the stepping's rounding is harmless.
+*/
+static void spanPoints(const Vec3d &h, const Vec3d &d, int n, float *su, float *sv, float *rz){
+  int i = 0;
+#if defined(__AVX__)
+  __m256d lane = _mm256_set_pd(3, 2, 1, 0);
+  __m256d hx = _mm256_add_pd(_mm256_set1_pd(h[0]), _mm256_mul_pd(lane, _mm256_set1_pd(d[0])));
+  __m256d hy = _mm256_add_pd(_mm256_set1_pd(h[1]), _mm256_mul_pd(lane, _mm256_set1_pd(d[1])));
+  __m256d hz = _mm256_add_pd(_mm256_set1_pd(h[2]), _mm256_mul_pd(lane, _mm256_set1_pd(d[2])));
+  __m256d dx = _mm256_set1_pd(4 * d[0]), dy = _mm256_set1_pd(4 * d[1]), dz = _mm256_set1_pd(4 * d[2]);
+  __m256d one = _mm256_set1_pd(1.0);
+  for(; i + 4 <= n; i += 4){
+    __m256d r = _mm256_div_pd(one, hz);
+    _mm_storeu_ps(su + i, _mm256_cvtpd_ps(_mm256_mul_pd(hx, r)));
+    _mm_storeu_ps(sv + i, _mm256_cvtpd_ps(_mm256_mul_pd(hy, r)));
+    _mm_storeu_ps(rz + i, _mm256_cvtpd_ps(r));
+    hx = _mm256_add_pd(hx, dx);
+    hy = _mm256_add_pd(hy, dy);
+    hz = _mm256_add_pd(hz, dz);
+  }
+#elif defined(__SSE2__)
+  __m128d lane = _mm_set_pd(1, 0);
+  __m128d hx = _mm_add_pd(_mm_set1_pd(h[0]), _mm_mul_pd(lane, _mm_set1_pd(d[0])));
+  __m128d hy = _mm_add_pd(_mm_set1_pd(h[1]), _mm_mul_pd(lane, _mm_set1_pd(d[1])));
+  __m128d hz = _mm_add_pd(_mm_set1_pd(h[2]), _mm_mul_pd(lane, _mm_set1_pd(d[2])));
+  __m128d dx = _mm_set1_pd(2 * d[0]), dy = _mm_set1_pd(2 * d[1]), dz = _mm_set1_pd(2 * d[2]);
+  __m128d one = _mm_set1_pd(1.0);
+  for(; i + 2 <= n; i += 2){
+    __m128d r = _mm_div_pd(one, hz);
+    _mm_storel_pi((__m64 *)(su + i), _mm_cvtpd_ps(_mm_mul_pd(hx, r)));
+    _mm_storel_pi((__m64 *)(sv + i), _mm_cvtpd_ps(_mm_mul_pd(hy, r)));
+    _mm_storel_pi((__m64 *)(rz + i), _mm_cvtpd_ps(r));
+    hx = _mm_add_pd(hx, dx);
+    hy = _mm_add_pd(hy, dy);
+    hz = _mm_add_pd(hz, dz);
+  }
+#endif
+  for(; i < n; i++){
+    double r = 1.0 / (h[2] + i * d[2]);
+    su[i] = (h[0] + i * d[0]) * r;
+    sv[i] = (h[1] + i * d[1]) * r;
+    rz[i] = r;
+  }
+}
+
+/*
+ RGBA colors as four floats while they are filtered, one SSE register when there is SSE2.
+*/
+#if defined(__SSE2__)
+typedef __m128 Color;
+
+static inline Color zeroColor(){ return _mm_setzero_ps(); }
+
+static inline Color loadColor(const Pixel &p){
+  int bytes;
+  memcpy(&bytes, &p, sizeof(bytes));
+  __m128i zero = _mm_setzero_si128();
+  __m128i v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero);
+  return _mm_cvtepi32_ps(v);
+}
+
+// acc + w * c
+static inline Color addWeighted(Color acc, float w, Color c){
+  return _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w), c));
+}
+
+// rounds to the nearest byte, saturating at 0 and 255
+static inline Pixel storeColor(Color c){
+  __m128i v = _mm_cvtps_epi32(c);
+  v = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+  int bytes = _mm_cvtsi128_si32(v);
+  Pixel p;
+  memcpy(&p, &bytes, sizeof(p));
+  return p;
+}
+#else
+struct Color{ float c[4]; };
+
+static inline Color zeroColor(){ Color z = {{0, 0, 0, 0}}; return z; }
+
+static inline Color loadColor(const Pixel &p){ Color c = {{(float)p.r, (float)p.g, (float)p.b, (float)p.a}}; return c; }
+
+static inline Color addWeighted(Color acc, float w, Color c){
+  for(int i = 0; i < 4; i++)
+    acc.c[i] += w * c.c[i];
+  return acc;
+}
+
+static inline unsigned char toByte(float x){ return x <= 0 ? 0 : (x >= 255 ? 255 : (unsigned char)(x + 0.5f)); }
+
+static inline Pixel storeColor(Color c){
+  Pixel p = {toByte(c.c[0]), toByte(c.c[1]), toByte(c.c[2]), toByte(c.c[3])};
+  return p;
+}
+#endif
+
+// Mitchell and Netravali's family of cubics. B = 0, C = 0.5 is Catmull-Rom, B = C = 1/3 Mitchell
+static double cubic(double x, double B, double C){
+  if(x < 1)
+    return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6;
+  if(x < 2)
+    return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6;
+  return 0;
+}
+
+static double lanczos(double x, int a){
+  if(x == 0)
+    return 1;
+  if(x >= a)
+    return 0;
+  double px = PI * x;
+  return a * sin(px) * sin(px / a) / (px * px);
+}
+
+static double kernelValue(Filter filter, double x){
+  switch(filter){
+    case BILINEAR: return x < 1 ? 1 - x : 0;
+    case CATMULL_ROM: return cubic(x, 0, 0.5);
+    case MITCHELL: return cubic(x, 1.0 / 3, 1.0 / 3);
+    case LANCZOS3: return lanczos(x, 3);
+    default: return 0;
+  }
+}
+
+/*
+ A separable reconstruction kernel, tabulated from 0 out to its radius. For 2D filtering it also
+ keeps the normalized weights of its 2 * radius taps at each phase, so a sample's weights are two
+ rows of that table, found from where it falls between pixels, rather than a lookup per tap. The
+ weights are kept in fixed point too, two taps to an int, summing to exactly 1 << WEIGHT_BITS.
+*/
+struct Kernel{
+  int radius;
+  float table[MAX_RADIUS * KERNEL_STEPS + 2];
+  float phases[KERNEL_PHASES + 1][2 * MAX_RADIUS];
+  int pairs[KERNEL_PHASES + 1][MAX_RADIUS];
+
+  Kernel(Filter filter){
+    radius = filter == BILINEAR ? 1 : (filter == LANCZOS3 ? 3 : 2);
+    for(int i = 0; i < MAX_RADIUS * KERNEL_STEPS + 2; i++){
+      double x = (double)i / KERNEL_STEPS;
+      table[i] = x < radius ? kernelValue(filter, x) : 0;
+    }
+    for(int p = 0; p <= KERNEL_PHASES; p++){
+      double w[2 * MAX_RADIUS], sum = 0;
+      for(int k = 0; k < 2 * radius; k++){
+        w[k] = kernelValue(filter, fabs(k - radius + 1 - (double)p / KERNEL_PHASES));
+        sum += w[k];
+      }
+      for(int k = 0; k < 2 * MAX_RADIUS; k++)
+        phases[p][k] = k < 2 * radius ? w[k] / sum : 0;
+
+      // the rounding is made up on the tap nearest the sample, so flat areas stay flat
+      short fixed[2 * MAX_RADIUS];
+      int total = 0;
+      for(int k = 0; k < 2 * MAX_RADIUS; k++){
+        fixed[k] = (short)lrint(phases[p][k] * (1 << WEIGHT_BITS));
+        total += fixed[k];
+      }
+      fixed[radius - 1 + (2 * p >= KERNEL_PHASES)] += (1 << WEIGHT_BITS) - total;
+      for(int k = 0; k < MAX_RADIUS; k++)
+        pairs[p][k] = (unsigned short)fixed[2 * k] | (unsigned)(unsigned short)fixed[2 * k + 1] << 16;
+    }
+  }
+
+  float operator()(float x) const{
+    x = fabsf(x) * KERNEL_STEPS;
+    int i = (int)x;
+    if(i >= radius * KERNEL_STEPS)
+      return 0;
+    return table[i] + (x - i) * (table[i + 1] - table[i]);
+  }
+
+  // the phase of a sample that falls a fraction between 0 and 1 past a pixel
+  static int phase(float fraction){
+    return (int)(fraction * KERNEL_PHASES + 0.5f);
+  }
+};
+
+// one level of the source's mip pyramid. level 0 is the source itself
+struct MipLevel{
+  int width, height;
+  vector<Pixel *> rows;
+  vector<Pixel> pixels;
+};
+
+/*
+ Filters mix neighbouring pixels, so a source with any transparency is filtered with its colors
+ premultiplied by alpha, or the colors of transparent pixels, which never show, would bleed into the
+ pixels around them. Fills rows with a premultiplied copy of in, held by pixels, and returns true, or
+ returns false when every pixel of in is opaque and can be filtered as it is.
+*/
+static bool premultiply(Pixel **in, int inWidth, int inHeight, unique_ptr<Pixel[]> &pixels, vector<Pixel *> &rows){
+  unsigned char opaque = 255;
+  for(int r = 0; r < inHeight && opaque == 255; r++)
+    for(int c = 0; c < inWidth; c++)
+      opaque &= in[r][c].a;
+  if(opaque == 255)
+    return false;
+
+  pixels.reset(new Pixel[(size_t)inWidth * inHeight]);
+  rows.resize(inHeight);
+  parallelRows(inHeight, [&](int rowBegin, int rowEnd){
+    for(int r = rowBegin; r < rowEnd; r++){
+      rows[r] = &pixels[(size_t)r * inWidth];
+      for(int c = 0; c < inWidth; c++){
+        Pixel p = in[r][c];
+        Pixel q = {(unsigned char)((p.r * p.a + 127) / 255), (unsigned char)((p.g * p.a + 127) / 255),
+                   (unsigned char)((p.b * p.a + 127) / 255), p.a};
+        rows[r][c] = q;
+      }
+    }
+  });
+  return true;
+}
+
+// turns the premultiplied output of a filter back into straight colors
+static void unpremultiply(Pixel **out, int outWidth, int outHeight){
+  parallelRows(outHeight, [&](int rowBegin, int rowEnd){
+    for(int r = rowBegin; r < rowEnd; r++){
+      for(int c = 0; c < outWidth; c++){
+        Pixel &p = out[r][c];
+        int a = p.a;
+        if(a == 255)
+          continue;
+        if(a == 0){
+          memset(&p, 0, sizeof(p));
+          continue;
+        }
+        p.r = (unsigned char)min(255, (p.r * 255 + a / 2) / a);
+        p.g = (unsigned char)min(255, (p.g * 255 + a / 2) / a);
+        p.b = (unsigned char)min(255, (p.b * 255 + a / 2) / a);
+      }
+    }
+  });
+}
+
+// the source and its 2x2 box filtered reductions, down to a single pixel
+static vector<MipLevel> buildMipmap(Pixel **in, int inWidth, int inHeight){
+  vector<MipLevel> mip(1);
+  mip[0].width = inWidth;
+  mip[0].height = inHeight;
+  mip[0].rows.assign(in, in + inHeight);
+
+  while(mip.back().width > 1 || mip.back().height > 1){
+    const MipLevel &prev = mip.back();
+    MipLevel next;
+    next.width = (prev.width + 1) / 2;
+    next.height = (prev.height + 1) / 2;
+    next.pixels.resize((size_t)next.width * next.height);
+    for(int r = 0; r < next.height; r++)
+      next.rows.push_back(&next.pixels[(size_t)r * next.width]);
+
+    parallelRows(next.height, [&](int rowBegin, int rowEnd){
+      for(int r = rowBegin; r < rowEnd; r++){
+        // odd sizes repeat the last row or column
+        const Pixel *row0 = prev.rows[2 * r];
+        const Pixel *row1 = prev.rows[min(2 * r + 1, prev.height - 1)];
+        for(int c = 0; c < next.width; c++){
+          int c0 = 2 * c, c1 = min(2 * c + 1, prev.width - 1);
+          Color sum = addWeighted(addWeighted(zeroColor(), 0.25f, loadColor(row0[c0])), 0.25f, loadColor(row0[c1]));
+          sum = addWeighted(addWeighted(sum, 0.25f, loadColor(row1[c0])), 0.25f, loadColor(row1[c1]));
+          next.rows[r][c] = storeColor(sum);
+        }
+      }
+    });
+    mip.push_back(std::move(next));
+  }
+  return mip;
+}
+
+static inline int clampIndex(int i, int n){
+  return i < 0 ? 0 : (i >= n ? n - 1 : i);
+}
+
+/*
+ Filters TAPS x TAPS pixels of a level, whose first is column x, row y, at phases px along the rows
+ and py down the columns. Taps past the edges repeat the edge pixels. Inside the level, with SSE2,
+ the rows are filtered two pixels at a time in 16 bit fixed point, and the columns in float.
+*/
+template <int TAPS>
+static inline Color filterTaps(const MipLevel &level, const Kernel &kernel, int x, int y, int px, int py){
+  const float *wx = kernel.phases[px], *wy = kernel.phases[py];
+  Color sum = zeroColor();
+  if(x >= 0 && x + TAPS <= level.width && y >= 0 && y + TAPS <= level.height){
+#if defined(__SSE2__)
+    const int *pair = kernel.pairs[px];
+    __m128i zero = _mm_setzero_si128();
+    for(int j = 0; j < TAPS; j++){
+      const Pixel *row = level.rows[y + j] + x;
+      __m128i rowSum = zero;
+      for(int i = 0; i < TAPS; i += 2){
+        // r0 r1 g0 g1 b0 b1 a0 a1, times w0 w1 and summed in pairs
+        __m128i two = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(row + i)), zero);
+        two = _mm_unpacklo_epi16(two, _mm_srli_si128(two, 8));
+        rowSum = _mm_add_epi32(rowSum, _mm_madd_epi16(two, _mm_set1_epi32(pair[i / 2])));
+      }
+      sum = addWeighted(sum, wy[j], _mm_cvtepi32_ps(rowSum));
+    }
+    return _mm_mul_ps(sum, _mm_set1_ps(1.0f / (1 << WEIGHT_BITS)));
+#else
+    for(int j = 0; j < TAPS; j++){
+      const Pixel *row = level.rows[y + j] + x;
+      Color rowSum = zeroColor();
+      for(int i = 0; i < TAPS; i++)
+        rowSum = addWeighted(rowSum, wx[i], loadColor(row[i]));
+      sum = addWeighted(sum, wy[j], rowSum);
+    }
+    return sum;
+#endif
+  }
+
+  int xs[TAPS];
+  for(int i = 0; i < TAPS; i++)
+    xs[i] = clampIndex(x + i, level.width);
+  for(int j = 0; j < TAPS; j++){
+    const Pixel *row = level.rows[clampIndex(y + j, level.height)];
+    Color rowSum = zeroColor();
+    for(int i = 0; i < TAPS; i++)
+      rowSum = addWeighted(rowSum, wx[i], loadColor(row[xs[i]]));
+    sum = addWeighted(sum, wy[j], rowSum);
+  }
+  return sum;
+}
+
+// filters a level at (sx, sy), in pixel center coordinates
+static Color sample(const MipLevel &level, const Kernel &kernel, float sx, float sy){
+  int ix = (int)floorf(sx), iy = (int)floorf(sy);
+  int px = Kernel::phase(sx - ix), py = Kernel::phase(sy - iy);
+  int x = ix - kernel.radius + 1, y = iy - kernel.radius + 1;
+  switch(kernel.radius){
+    case 1: return filterTaps<2>(level, kernel, x, y, px, py);
+    case 2: return filterTaps<4>(level, kernel, x, y, px, py);
+    default: return filterTaps<6>(level, kernel, x, y, px, py);
+  }
+}
+
+// filters the mip level that is detail of the given scale, at source position (u, v)
+static Color sampleLevel(const vector<MipLevel> &mip, const Kernel &kernel, int level, float u, float v){
+  float scale = ldexpf(1, -level);
+  return sample(mip[level], kernel, u * scale - 0.5f, v * scale - 0.5f);
+}
+
+/*
+ Filters the source at (u, v) for an output pixel whose footprint in the source is the longer of how
+ far the source point moves for a step in x and in y, squared. Where that covers more than one
+ source pixel, the two mip levels around it are filtered and blended (trilinear mip mapping).
+*/
+static Color filterPoint(const vector<MipLevel> &mip, const Kernel &kernel, float u, float v, float footprint){
+  if(footprint <= 1)
+    return sampleLevel(mip, kernel, 0, u, v);
+
+  int last = mip.size() - 1;
+  float lambda = 0.5f * log2f(footprint);
+  int level = (int)lambda;
+  if(level >= last)
+    return sampleLevel(mip, kernel, last, u, v);
+
+  float t = lambda - level;
+  return addWeighted(addWeighted(zeroColor(), 1 - t, sampleLevel(mip, kernel, level, u, v)),
+                     t, sampleLevel(mip, kernel, level + 1, u, v));
+}
+
+/*
+ Filters pixels [x0, x1) of a scanline from the source. e is the step of the homogeneous point from
+ one scanline to the next, which with d gives the footprint of each pixel. A block of pixels has
+ its footprints, and the first tap and phase of those that only need the source itself, worked out
+ together, four at a time with SSE2, before any is filtered. The rest go through filterPoint.
+*/
+template <int TAPS>
+static void filterSpan(const vector<MipLevel> &mip, const Kernel &kernel, const Vec3d &h, const Vec3d &d,
+                       const Vec3d &e, int x0, int x1, Pixel *row){
+  float su[WARP_BLOCK], sv[WARP_BLOCK], rz[WARP_BLOCK], footprint[WARP_BLOCK];
+  int tx[WARP_BLOCK], ty[WARP_BLOCK], px[WARP_BLOCK], py[WARP_BLOCK];
+  const int reach = TAPS / 2 - 1;
+  for(int x = x0; x < x1; x += WARP_BLOCK){
+    int n = x1 - x < WARP_BLOCK ? x1 - x : WARP_BLOCK;
+    Vec3d start = h + d * x;
+    spanPoints(start, d, n, su, sv, rz);
+
+    int i = 0;
+#if defined(__SSE2__)
+    __m128 dx = _mm_set1_ps(d[0]), dy = _mm_set1_ps(d[1]), dz = _mm_set1_ps(d[2]);
+    __m128 ex = _mm_set1_ps(e[0]), ey = _mm_set1_ps(e[1]), ez = _mm_set1_ps(e[2]);
+    __m128 half = _mm_set1_ps(0.5f), phases = _mm_set1_ps(KERNEL_PHASES);
+    __m128i offset = _mm_set1_epi32(reach), one = _mm_set1_epi32(1);
+    for(; i + 4 <= n; i += 4){
+      __m128 u = _mm_loadu_ps(su + i), v = _mm_loadu_ps(sv + i), r = _mm_loadu_ps(rz + i);
+      __m128 ux = _mm_mul_ps(_mm_sub_ps(dx, _mm_mul_ps(u, dz)), r), vx = _mm_mul_ps(_mm_sub_ps(dy, _mm_mul_ps(v, dz)), r);
+      __m128 uy = _mm_mul_ps(_mm_sub_ps(ex, _mm_mul_ps(u, ez)), r), vy = _mm_mul_ps(_mm_sub_ps(ey, _mm_mul_ps(v, ez)), r);
+      _mm_storeu_ps(footprint + i, _mm_max_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(vx, vx)),
+                                              _mm_add_ps(_mm_mul_ps(uy, uy), _mm_mul_ps(vy, vy))));
+
+      // floor of the pixel center coordinates, by truncating and stepping back the negative ones
+      __m128 sx = _mm_sub_ps(u, half), sy = _mm_sub_ps(v, half);
+      __m128i ix = _mm_cvttps_epi32(sx), iy = _mm_cvttps_epi32(sy);
+      ix = _mm_sub_epi32(ix, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(sx, _mm_cvtepi32_ps(ix))), one));
+      iy = _mm_sub_epi32(iy, _mm_and_si128(_mm_castps_si128(_mm_cmplt_ps(sy, _mm_cvtepi32_ps(iy))), one));
+      _mm_storeu_si128((__m128i *)(tx + i), _mm_sub_epi32(ix, offset));
+      _mm_storeu_si128((__m128i *)(ty + i), _mm_sub_epi32(iy, offset));
+      _mm_storeu_si128((__m128i *)(px + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(sx, _mm_cvtepi32_ps(ix)), phases)));
+      _mm_storeu_si128((__m128i *)(py + i), _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(sy, _mm_cvtepi32_ps(iy)), phases)));
+    }
+#endif
+    for(; i < n; i++){
+      float u = su[i], v = sv[i], r = rz[i];
+
+      // jacobian of the projective map at this pixel
+      float ux = (d[0] - u * d[2]) * r, vx = (d[1] - v * d[2]) * r;
+      float uy = (e[0] - u * e[2]) * r, vy = (e[1] - v * e[2]) * r;
+      footprint[i] = fmaxf(ux * ux + vx * vx, uy * uy + vy * vy);
+
+      float sx = u - 0.5f, sy = v - 0.5f;
+      int ix = (int)floorf(sx), iy = (int)floorf(sy);
+      tx[i] = ix - reach;
+      ty[i] = iy - reach;
+      px[i] = Kernel::phase(sx - ix);
+      py[i] = Kernel::phase(sy - iy);
+    }
+
+    for(i = 0; i < n; i++){
+      if(footprint[i] <= 1)
+        row[x + i] = storeColor(filterTaps<TAPS>(mip[0], kernel, tx[i], ty[i], px[i], py[i]));
+      else
+        row[x + i] = storeColor(filterPoint(mip, kernel, su[i], sv[i], footprint[i]));
+    }
+  }
+}
+
+// whether output pixel x of a scanline maps to a pixel of the source
+static bool inside(const Scanline &s, int x, int inWidth, int inHeight){
+  Vec3d h = s.point(x);
+  int u = h[0] / h[2];
+  int v = h[1] / h[2];
+  return u >= 0 && u < inWidth && v >= 0 && v < inHeight;
+}
+
+// narrows [lo, hi) to the integer x where a + b * x > -slack
+static void keepPositive(double a, double b, double slack, double &lo, double &hi){
+  a += slack;
+  if(b == 0){
+    if(a <= 0)
+      hi = lo;
+    return;
+  }
+  double root = -a / b;
+  if(b > 0)
+    lo = fmax(lo, floor(root) + 1);
+  else
+    hi = fmin(hi, ceil(root));
+}
+
+/*
+ Finds the spans of pixels [xBegin, xEnd) of a scanline whose source pixel is inside the source
+ image. Pixel x maps inside when -1 < hx / hz < inWidth and -1 < hy / hz < inHeight (coordinates are
+ truncated toward zero). Where hz keeps its sign these are four linear inequalities in x, so each
+ side of the point where hz crosses zero holds at most one span. The inequalities are loosened by
+ far more than the rounding in evaluating them, and the ends found are trimmed with the exact test,
+ so rounding never drops a pixel that is inside. A pixel within rounding of an edge may still fall
+ just outside in the middle of a span, so callers that need it exact test each pixel. Returns the
+ number of spans, at most two, in order.
+*/
+static int clipSpans(const Scanline &s, int inWidth, int inHeight, int xBegin, int xEnd, int spans[2][2]){
+  Vec3d h = s.point(0), d = s.a;
+  double split = xEnd;
+  if(d[2] != 0)
+    split = fmin(fmax(ceil(-h[2] / d[2]), xBegin), xEnd);
+  double pieces[2][2] = {{(double)xBegin, split}, {split, (double)xEnd}};
+
+  // the size of the terms the inequalities are made of, which their rounding is relative to
+  double size = 0;
+  for(int i = 0; i < 3; i++)
+    size += fabs(d[i]) * (fabs(s.left) + max(abs(xBegin), abs(xEnd))) + fabs(s.b[i]) + fabs(s.c[i]);
+  double slack = 1e-9 * size * (max(inWidth, inHeight) + 1);
+
+  int count = 0;
+  for(int p = 0; p < 2; p++){
+    double lo = pieces[p][0], hi = pieces[p][1];
+    if(lo >= hi)
+      continue;
+
+    // sign of hz over the piece
+    double sign = h[2] + 0.5 * (lo + hi) * d[2] < 0 ? -1 : 1;
+    keepPositive(sign * h[2], sign * d[2], 0, lo, hi);
+    keepPositive(sign * (h[0] + h[2]), sign * (d[0] + d[2]), slack, lo, hi);
+    keepPositive(sign * (inWidth * h[2] - h[0]), sign * (inWidth * d[2] - d[0]), slack, lo, hi);
+    keepPositive(sign * (h[1] + h[2]), sign * (d[1] + d[2]), slack, lo, hi);
+    keepPositive(sign * (inHeight * h[2] - h[1]), sign * (inHeight * d[2] - d[1]), slack, lo, hi);
+    if(lo >= hi + 2)
+      continue;
+
+    int x0 = (int)fmax(lo - 1, pieces[p][0]);
+    int x1 = (int)fmin(hi + 1, pieces[p][1]);
+    while(x0 < x1 && !inside(s, x0, inWidth, inHeight))
+      x0++;
+    while(x1 > x0 && !inside(s, x1 - 1, inWidth, inHeight))
+      x1--;
+    if(x0 < x1){
+      spans[count][0] = x0;
+      spans[count][1] = x1;
+      count++;
+    }
+  }
+  return count;
+}
+
+// copies pixels [x0, x1) of a scanline from the source, or clears those that rounding puts just
+// outside it
+static void warpSpan(Pixel **in, int inWidth, int inHeight, const Scanline &s, int x0, int x1, Pixel *row){
+  int u[WARP_BLOCK], v[WARP_BLOCK];
+  bool affine = s.a[2] == 0;
+  for(int x = x0; x < x1; x += WARP_BLOCK){
+    int n = x1 - x < WARP_BLOCK ? x1 - x : WARP_BLOCK;
+    if(affine)
+      affineCoordinates(s, x, n, u, v);
+    else
+      spanCoordinates(s, x, n, u, v);
+
+    for(int i = 0; i < n; i++){
+      if((unsigned)u[i] < (unsigned)inWidth && (unsigned)v[i] < (unsigned)inHeight)
+        row[x + i] = in[v[i]][u[i]];
+      else
+        memset(&row[x + i], 0, sizeof(Pixel));
+    }
+  }
+}
+
+// source index value truncates to, or -1 when that is outside [0, limit)
+static inline int mapIndex(double value, int limit){
+  return value > -1 && value < limit ? (int)value : -1;
+}
+
+/*
+ Where the warp maps output columns to a fixed set of source columns (or rows, when it transposes),
+ the map is worked out once for the whole image rather than per pixel.
+*/
+struct ColumnMap{
+  vector<int> index;  // source column or row of each output column
+  int begin, end;     // the output columns whose index is inside the source
+  int step;           // 1 or -1 when index steps by exactly that across [begin, end), otherwise 0
+};
+
+// maps output column x to (scale * (x + origin) + offset) / z, truncated, with limit source columns
+// or rows. this is the per-pixel loop's arithmetic with the terms that are 0 left out, so it picks
+// the same pixels
+static ColumnMap mapColumns(double scale, double origin, double offset, double z, int outWidth, int limit){
+  ColumnMap map;
+  map.index.resize(outWidth);
+  map.begin = outWidth;
+  map.end = 0;
+  for(int x = 0; x < outWidth; x++){
+    map.index[x] = mapIndex((scale * (x + origin) + offset) / z, limit);
+    if(map.index[x] >= 0){
+      map.begin = min(map.begin, x);
+      map.end = x + 1;
+    }
+  }
+
+  map.step = scale / z > 0 ? 1 : -1;
+  for(int x = map.begin + 1; x < map.end && map.step != 0; x++)
+    if(map.index[x] != map.index[x - 1] + map.step)
+      map.step = 0;
+  return map;
+}
+
+// copies pixels [x0, x1) of a scanline from a source row through a map of its columns: straight
+// across, reversed, or gathered
+static void axisSpan(const Pixel *source, const ColumnMap &columns, int x0, int x1, Pixel *row){
+  const int *index = &columns.index[0];
+  if(columns.step == 1){
+    memcpy(row + x0, source + index[x0], (x1 - x0) * sizeof(Pixel));
+  }
+  else if(columns.step == -1){
+    const Pixel *p = source + index[x0];
+    for(int x = x0; x < x1; x++)
+      row[x] = *p--;
+  }
+  else{
+    for(int x = x0; x < x1; x++)
+      row[x] = source[index[x]];
+  }
+}
+
+// copies pixels [x0, x1) of a scanline down one source column through a map of its rows. the output
+// is tiled, so the rows a tile reads stay cached for the next columns and this is a blocked transpose
+static void transposeSpan(Pixel **in, int column, const ColumnMap &rows, int x0, int x1, Pixel *row){
+  const int *index = &rows.index[0];
+  for(int x = x0; x < x1; x++)
+    row[x] = in[index[x]][column];
+}
+
+/*
+ Normalizes map, the warp from output pixel (x, y) to the source, and makes coefficients that are
+ within rounding of 0 or +-1, and offsets within rounding of a whole pixel, exact. A coefficient is
+ weighed by the extent of the output it is multiplied across, so the perspective row is only dropped
+ when no corner of the output moves by more than SNAP pixels without it. Returns its class.
+*/
+static WarpClass snapMap(Mat3d &map, int outWidth, int outHeight){
+  if(fabs(map[2][2]) < SNAP)
+    return PROJECTIVE;
+  double z = map[2][2];
+  for(int i = 0; i < 3; i++)
+    for(int j = 0; j < 3; j++)
+      map[i][j] /= z;
+
+  if(map[2][0] != 0 || map[2][1] != 0){
+    Mat3d affine = map;
+    affine[2][0] = affine[2][1] = 0;
+    for(int corner = 0; corner < 4; corner++){
+      Vec2d p((corner & 1) * (double)outWidth, (corner >> 1) * (double)outHeight);
+      Vec2d moved = project(map * p) - project(affine * p);
+      if(!(fabs(moved[0]) + fabs(moved[1]) < SNAP))
+        return PROJECTIVE;
+    }
+    map[2][0] = map[2][1] = 0;
+  }
+
+  double extent[2] = {fmax(outWidth, 1), fmax(outHeight, 1)};
+  for(int i = 0; i < 2; i++){
+    for(int j = 0; j < 2; j++){
+      double c = map[i][j];
+      if(fabs(c) * extent[j] < SNAP)
+        map[i][j] = 0;
+      else if(fabs(fabs(c) - 1) * extent[j] < SNAP)
+        map[i][j] = c < 0 ? -1 : 1;
+    }
+    if(fabs(map[i][2] - round(map[i][2])) < SNAP)
+      map[i][2] = round(map[i][2]);
+  }
+
+  bool diagonal = map[0][1] == 0 && map[1][0] == 0;
+  bool transposing = map[0][0] == 0 && map[1][1] == 0;
+  bool whole = map[0][2] == floor(map[0][2]) && map[1][2] == floor(map[1][2]);
+  if(diagonal && map[0][0] == 1 && map[1][1] == 1 && whole)
+    return map[0][2] == 0 && map[1][2] == 0 ? IDENTITY : INTEGER_TRANSLATION;
+  if(diagonal && fabs(map[0][0]) == 1 && fabs(map[1][1]) == 1 && whole)
+    return RIGHT_ANGLE;
+  if(diagonal)
+    return AXIS_SCALE;
+  if(transposing && fabs(map[0][1]) == 1 && fabs(map[1][0]) == 1 && whole)
+    return RIGHT_ANGLE;
+  return AFFINE;
+}
+
+// the warp from output pixel (x, y) to the source, for output pixel (x, y) at (x + left, y + bottom)
+static Mat3d pixelMap(const Matrix3D &inverse, double left, double bottom){
+  return inverse.mat() * translation(left, bottom);
+}
+
+WarpClass classifyWarp(const Matrix3D &inverse, double left, double bottom, int outWidth, int outHeight){
+  Mat3d map = pixelMap(inverse, left, bottom);
+  return snapMap(map, outWidth, outHeight);
+}
+
+/*
+ Asks for the source pixels a tile will read to be brought into cache ahead of it. The footprint is
+ the bounding box of the tile's corners mapped into the source, padded by pad pixels for the filter.
+ Tiles that cross the horizon (hz <= 0 at a corner), or whose footprint is too big to stay cached,
+ are left alone.
+*/
+static void prefetchFootprint(Pixel **in, int inWidth, int inHeight, const Mat3d &inv,
+                              double x, double y, int width, int height, int pad){
+#if defined(__SSE2__)
+  double u0 = HUGE_VAL, u1 = -HUGE_VAL, v0 = HUGE_VAL, v1 = -HUGE_VAL;
+  for(int corner = 0; corner < 4; corner++){
+    Vec3d h = inv * Vec2d(x + (corner & 1) * width, y + (corner >> 1) * height);
+    if(h[2] <= 0)
+      return;
+    Vec2d p = project(h);
+    u0 = fmin(u0, p[0]);
+    u1 = fmax(u1, p[0]);
+    v0 = fmin(v0, p[1]);
+    v1 = fmax(v1, p[1]);
+  }
+
+  int c0 = clampIndex((int)floor(u0) - pad, inWidth), c1 = clampIndex((int)ceil(u1) + pad, inWidth);
+  int r0 = clampIndex((int)floor(v0) - pad, inHeight), r1 = clampIndex((int)ceil(v1) + pad, inHeight);
+  if((double)(c1 - c0 + 1) * (r1 - r0 + 1) > PREFETCH_RATIO * width * height)
+    return;
+
+  for(int r = r0; r <= r1; r++){
+    const char *begin = (const char *)(in[r] + c0), *end = (const char *)(in[r] + c1 + 1);
+    for(const char *line = begin; line < end; line += 64)
+      _mm_prefetch(line, _MM_HINT_T0);
+  }
+#endif
+}
+
+/*
+ dst, cols x rows, is src, rows x cols, transposed. It is worked in strips of TRANSPOSE_STRIP columns,
+ down all the rows, so the few rows of dst a strip writes are written in order, while the part of
+ each source row the strip reads is still cached for the next strip. Within a strip, blocks of 4x4
+ pixels are transposed in registers.
+*/
+static void transposePixels(const Pixel *src, int rows, int cols, Pixel *dst){
+  int strips = (cols + TRANSPOSE_STRIP - 1) / TRANSPOSE_STRIP;
+  parallelRows(strips, [&](int stripBegin, int stripEnd){
+    for(int c0 = stripBegin * TRANSPOSE_STRIP; c0 < min(stripEnd * TRANSPOSE_STRIP, cols); c0 += TRANSPOSE_STRIP){
+      int c1 = min(c0 + TRANSPOSE_STRIP, cols);
+      int r = 0;
+#if defined(__SSE2__)
+      for(; r + 4 <= rows; r += 4){
+        int c = c0;
+        for(; c + 4 <= c1; c += 4){
+          __m128 a = _mm_loadu_ps((const float *)(src + (size_t)r * cols + c));
+          __m128 b = _mm_loadu_ps((const float *)(src + (size_t)(r + 1) * cols + c));
+          __m128 e = _mm_loadu_ps((const float *)(src + (size_t)(r + 2) * cols + c));
+          __m128 f = _mm_loadu_ps((const float *)(src + (size_t)(r + 3) * cols + c));
+          _MM_TRANSPOSE4_PS(a, b, e, f);
+          _mm_storeu_ps((float *)(dst + (size_t)c * rows + r), a);
+          _mm_storeu_ps((float *)(dst + (size_t)(c + 1) * rows + r), b);
+          _mm_storeu_ps((float *)(dst + (size_t)(c + 2) * rows + r), e);
+          _mm_storeu_ps((float *)(dst + (size_t)(c + 3) * rows + r), f);
+        }
+        for(; c < c1; c++)
+          for(int i = 0; i < 4; i++)
+            dst[(size_t)c * rows + r + i] = src[(size_t)(r + i) * cols + c];
+      }
+#endif
+      for(; r < rows; r++)
+        for(int c = c0; c < c1; c++)
+          dst[(size_t)c * rows + r] = src[(size_t)r * cols + c];
+    }
+  });
+}
+
+/*
+ The weights of a kernel stretched by stretch, kept as Kernel keeps its pairs: for each phase the
+ normalized weights of the taps it reaches, in fixed point, two taps to an int, with the rounding
+ made up on the tap nearest the sample.
+*/
+struct TapTable{
+  int taps;
+  vector<int> pairs;
+
+  TapTable(const Kernel &kernel, double stretch){
+    taps = 2 * (int)ceil(kernel.radius * stretch - 1e-9);
+    pairs.resize((size_t)(KERNEL_PHASES + 1) * taps / 2);
+    vector<double> w(taps);
+    vector<short> fixed(taps);
+    for(int p = 0; p <= KERNEL_PHASES; p++){
+      double sum = 0;
+      for(int k = 0; k < taps; k++){
+        w[k] = kernel((k - taps / 2 + 1 - (double)p / KERNEL_PHASES) / stretch);
+        sum += w[k];
+      }
+      int total = 0;
+      for(int k = 0; k < taps; k++){
+        fixed[k] = (short)lrint(w[k] / sum * (1 << WEIGHT_BITS));
+        total += fixed[k];
+      }
+      fixed[taps / 2 - 1 + (2 * p >= KERNEL_PHASES)] += (1 << WEIGHT_BITS) - total;
+      for(int k = 0; k < taps / 2; k++)
+        pairs[(size_t)p * taps / 2 + k] = (unsigned short)fixed[2 * k] | (unsigned)(unsigned short)fixed[2 * k + 1] << 16;
+    }
+  }
+
+  const int *phase(int p) const{ return &pairs[(size_t)p * taps / 2]; }
+};
+
+// a position stepped along a row in 32.32 fixed point, so finding each pixel's taps and phase takes
+// no floor or conversion
+struct Stepper{
+  long long position, step;
+
+  Stepper(double first, double step) : position(llrint(ldexp(first, 32))), step(llrint(ldexp(step, 32))) {}
+
+  // the first of taps taps around the position, kept within [-taps, length], and its phase
+  int tap(int taps, int length, int &phase) const{
+    long long whole = position >> 32;
+    phase = (int)(((position & 0xffffffffLL) * KERNEL_PHASES + (1LL << 31)) >> 32);
+    return (int)min(max(whole - taps / 2 + 1, (long long)-taps), (long long)length);
+  }
+};
+
+#if defined(__SSE2__)
+// two neighbouring pixels of a row times the pair of weights w, summed by channel
+static inline __m128i rowPair(const Pixel *p, int w){
+  // r0 r1 g0 g1 b0 b1 a0 a1, times w0 w1 and summed in pairs
+  __m128i two = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+  return _mm_madd_epi16(_mm_unpacklo_epi16(two, _mm_srli_si128(two, 8)), _mm_set1_epi32(w));
+}
+
+// as rowPair, for pixels p0 and p1 from two rows
+static inline __m128i columnPair(const Pixel *p0, const Pixel *p1, int w){
+  int a, b;
+  memcpy(&a, p0, sizeof(Pixel));
+  memcpy(&b, p1, sizeof(Pixel));
+  __m128i two = _mm_unpacklo_epi8(_mm_cvtsi32_si128(a), _mm_cvtsi32_si128(b));
+  return _mm_madd_epi16(_mm_unpacklo_epi8(two, _mm_setzero_si128()), _mm_set1_epi32(w));
+}
+
+// the sums of a pixel's pairs of taps, in fixed point, rounded to a pixel
+static inline void storeSum(__m128i sum, Pixel *dst){
+  sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(1 << (WEIGHT_BITS - 1))), WEIGHT_BITS);
+  sum = _mm_packus_epi16(_mm_packs_epi32(sum, sum), _mm_setzero_si128());
+  int packed = _mm_cvtsi128_si32(sum);
+  memcpy(dst, &packed, sizeof(Pixel));
+}
+#endif
+
+/*
+ Fills count pixels of dst from the row src, length pixels long, resampled at first + step * i for
+ pixel i, in pixel center coordinates, with taps past the ends repeating the end pixels. The row is
+ copied out with its ends repeated once more than the taps over, so no tap needs clamping. Each
+ pixel's weights are the row of the table for where it falls, and its taps are filtered two at a
+ time in fixed point. TAPS is the table's taps, or 0 for a table too wide to unroll.
+*/
+template <int TAPS>
+static void stepRow(const Pixel *src, int length, double first, double step, const TapTable &table, Pixel *dst, int count){
+  const int taps = TAPS ? TAPS : table.taps;
+  vector<Pixel> padded(length + 2 * taps + 2);
+  fill(padded.begin(), padded.begin() + taps + 1, src[0]);
+  copy(src, src + length, padded.begin() + taps + 1);
+  fill(padded.begin() + taps + 1 + length, padded.end(), src[length - 1]);
+  const Pixel *row = padded.data() + taps + 1;
+
+  Stepper at(first, step);
+  for(int i = 0; i < count; i++, at.position += at.step){
+    int phase, x = at.tap(taps, length, phase);
+    const int *pair = table.phase(phase);
+#if defined(__SSE2__)
+    // the unrolled kernels' pairs are written out, as the compiler leaves a loop of three
+    const Pixel *tap = row + x;
+    __m128i sum = rowPair(tap, pair[0]);
+    if(TAPS >= 4)
+      sum = _mm_add_epi32(sum, rowPair(tap + 2, pair[1]));
+    if(TAPS >= 6)
+      sum = _mm_add_epi32(sum, rowPair(tap + 4, pair[2]));
+    for(int k = 2; !TAPS && k < taps; k += 2)
+      sum = _mm_add_epi32(sum, rowPair(tap + k, pair[k / 2]));
+    storeSum(sum, dst + i);
+#else
+    int sum[4] = {0, 0, 0, 0};
+    for(int k = 0; k < taps; k++){
+      int w = (short)(pair[k / 2] >> (k & 1 ? 16 : 0));
+      const Pixel &p = row[x + k];
+      sum[0] += w * p.r; sum[1] += w * p.g; sum[2] += w * p.b; sum[3] += w * p.a;
+    }
+    for(int c = 0; c < 4; c++)
+      sum[c] = min(max((sum[c] + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS, 0), 255);
+    Pixel p = {(unsigned char)sum[0], (unsigned char)sum[1], (unsigned char)sum[2], (unsigned char)sum[3]};
+    dst[i] = p;
+#endif
+  }
+}
+
+/*
+ As stepRow, for pixels [x0, x1) of dst, each filtered down column x of rows at first + step * x.
+ rows has clamped rows before the first and after the last, as many as the taps and one more, and
+ the taps of a pixel are paired up from two rows at a time.
+*/
+template <int TAPS>
+static void stepColumns(const Pixel *const *rows, int height, double first, double step, const TapTable &table,
+                        int x0, int x1, Pixel *dst){
+  const int taps = TAPS ? TAPS : table.taps;
+  Stepper at(first + step * x0, step);
+  for(int x = x0; x < x1; x++, at.position += at.step){
+    int phase, y = at.tap(taps, height, phase);
+    const int *pair = table.phase(phase);
+#if defined(__SSE2__)
+    const Pixel *const *tap = rows + y;
+    __m128i sum = columnPair(tap[0] + x, tap[1] + x, pair[0]);
+    if(TAPS >= 4)
+      sum = _mm_add_epi32(sum, columnPair(tap[2] + x, tap[3] + x, pair[1]));
+    if(TAPS >= 6)
+      sum = _mm_add_epi32(sum, columnPair(tap[4] + x, tap[5] + x, pair[2]));
+    for(int k = 2; !TAPS && k < taps; k += 2)
+      sum = _mm_add_epi32(sum, columnPair(tap[k] + x, tap[k + 1] + x, pair[k / 2]));
+    storeSum(sum, dst + x);
+#else
+    int sum[4] = {0, 0, 0, 0};
+    for(int k = 0; k < taps; k++){
+      int w = (short)(pair[k / 2] >> (k & 1 ? 16 : 0));
+      const Pixel &p = rows[y + k][x];
+      sum[0] += w * p.r; sum[1] += w * p.g; sum[2] += w * p.b; sum[3] += w * p.a;
+    }
+    for(int c = 0; c < 4; c++)
+      sum[c] = min(max((sum[c] + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS, 0), 255);
+    Pixel p = {(unsigned char)sum[0], (unsigned char)sum[1], (unsigned char)sum[2], (unsigned char)sum[3]};
+    dst[x] = p;
+#endif
+  }
+}
+
+/*
+ Filters an affine warp in two 1D passes (Catmull and Smith). In pixel center coordinates the map
+ takes output (x, y) to source (u, v) = (a x + b y + cu, d x + e y + cv). Along output column x the
+ source point moves down the source rows, so pass 1 resamples each source row v at the u where
+ column x crosses it, which is linear in x:
+   pass 1  first(x, v) = source((a - b d / e) x + (b / e) v + cu - b cv / e, v)
+   pass 2  out(x, y) = first(x, d x + e y + cv)
+ Pass 2 reads down the columns of pass 1, whose rows are contiguous in x, so there is no transpose.
+ Where e is smaller than b the rows would be squeezed into a few pixels of pass 1 and blurred, so
+ the source is transposed first and its columns resampled instead. Each pass stretches its kernel by
+ how far apart neighbouring output columns (pass 1) or rows (pass 2) land in the source, measured
+ across them, so a warp that shrinks the image one way is only filtered harder that way. The output
+ is cleared outside the source just as warpImage clears it.
+*/
+static void separableWarp(Pixel **in, int inWidth, int inHeight, const Mat3d &inv, const Mat3d &map,
+                          double left, double bottom, const Kernel &kernel, Pixel **out, int outWidth, int outHeight){
+  double a = map[0][0], b = map[0][1], d = map[1][0], e = map[1][1];
+  double cu = map[0][2] + 0.5 * (a + b) - 0.5, cv = map[1][2] + 0.5 * (d + e) - 0.5;
+  double det = a * e - b * d;
+
+  vector<Pixel *> rows(in, in + inHeight);
+  int width = inWidth, height = inHeight;
+  unique_ptr<Pixel[]> flat, turned;
+  if(fabs(b) > fabs(e)){
+    const Pixel *source = in[0];
+    for(int r = 1; r < inHeight && source; r++)
+      if(in[r] != in[0] + (size_t)r * inWidth)
+        source = nullptr;
+    if(!source){
+      flat.reset(new Pixel[(size_t)inWidth * inHeight]);
+      for(int r = 0; r < inHeight; r++)
+        copy(in[r], in[r] + inWidth, &flat[(size_t)r * inWidth]);
+      source = flat.get();
+    }
+    turned.reset(new Pixel[(size_t)inWidth * inHeight]);
+    transposePixels(source, inHeight, inWidth, turned.get());
+    flat.reset();
+    swap(width, height);
+    rows.resize(height);
+    for(int r = 0; r < height; r++)
+      rows[r] = &turned[(size_t)r * width];
+    swap(a, d);
+    swap(b, e);
+    swap(cu, cv);
+  }
+
+  double alpha = a - b * d / e, beta = b / e, gamma = cu - b * cv / e;
+  TapTable rowTable(kernel, fmax(1, fabs(det) / hypot(b, e))), columnTable(kernel, fmax(1, fabs(det) / hypot(a, d)));
+
+  // the source rows pass 2 reads, from the output's corners out by the kernel's reach, and a few
+  // pixels more for the step from pixel corners to centers
+  double reach = columnTable.taps / 2 + fabs(a) + fabs(b) + fabs(d) + fabs(e) + 2;
+  double vLow = fmin(0, e * (outHeight - 1)), vHigh = fmax(0, e * (outHeight - 1));
+  double low = cv + vLow + fmin(0, d * (outWidth - 1)) - reach, high = cv + vHigh + fmax(0, d * (outWidth - 1)) + reach;
+  int rowBegin = (int)fmin(fmax(floor(low), 0), height - 1);
+  int rowEnd = (int)fmin(fmax(ceil(high) + 1, rowBegin + 1), height);
+
+  unique_ptr<Pixel[]> first(new Pixel[(size_t)(rowEnd - rowBegin) * outWidth]);
+  parallelRows(rowEnd - rowBegin, [&](int r0, int r1){
+    for(int j = rowBegin + r0; j < rowBegin + r1; j++){
+      // the columns that read source row j, where they cross it inside the source
+      double from = (-reach - beta * j - gamma) / alpha, to = (width + reach - beta * j - gamma) / alpha;
+      double begin = fmin(from, to), end = fmax(from, to);
+      if(fabs(d) * outWidth > 1e-9){
+        from = (j - cv - vHigh - reach) / d;
+        to = (j - cv - vLow + reach) / d;
+        begin = fmax(begin, fmin(from, to));
+        end = fmin(end, fmax(from, to));
+      }
+      int x0 = (int)fmin(fmax(floor(begin), 0), outWidth);
+      int x1 = (int)fmin(fmax(ceil(end) + 1, x0), outWidth);
+      double start = alpha * x0 + beta * j + gamma;
+      Pixel *row = &first[(size_t)(j - rowBegin) * outWidth + x0];
+      switch(rowTable.taps){
+        case 2: stepRow<2>(rows[j], width, start, alpha, rowTable, row, x1 - x0); break;
+        case 4: stepRow<4>(rows[j], width, start, alpha, rowTable, row, x1 - x0); break;
+        case 6: stepRow<6>(rows[j], width, start, alpha, rowTable, row, x1 - x0); break;
+        default: stepRow<0>(rows[j], width, start, alpha, rowTable, row, x1 - x0); break;
+      }
+    }
+  });
+  turned.reset();
+
+  // rows of pass 1 by source row, clamped, with one more than the taps past each end
+  int pad = columnTable.taps + 1;
+  vector<const Pixel *> firstRows(height + 2 * pad);
+  for(int j = -pad; j < height + pad; j++)
+    firstRows[j + pad] = &first[(size_t)(min(max(j, rowBegin), rowEnd - 1) - rowBegin) * outWidth];
+  const Pixel *const *columns = firstRows.data() + pad;
+
+  parallelRows(outHeight, [&](int yBegin, int yEnd){
+    for(int y = yBegin; y < yEnd; y++){
+      int spans[2][2];
+      int count = clipSpans(Scanline(inv, left, y + bottom), inWidth, inHeight, 0, outWidth, spans);
+      int x = 0;
+      for(int i = 0; i < count; i++){
+        memset(out[y] + x, 0, (spans[i][0] - x) * sizeof(Pixel));
+        int x0 = spans[i][0], x1 = spans[i][1];
+        switch(columnTable.taps){
+          case 2: stepColumns<2>(columns, height, e * y + cv, d, columnTable, x0, x1, out[y]); break;
+          case 4: stepColumns<4>(columns, height, e * y + cv, d, columnTable, x0, x1, out[y]); break;
+          case 6: stepColumns<6>(columns, height, e * y + cv, d, columnTable, x0, x1, out[y]); break;
+          default: stepColumns<0>(columns, height, e * y + cv, d, columnTable, x0, x1, out[y]); break;
+        }
+        x = spans[i][1];
+      }
+      memset(out[y] + x, 0, (outWidth - x) * sizeof(Pixel));
+    }
+  });
+}
+
+void warpImage(Pixel **in, int inWidth, int inHeight, const Matrix3D &inverse,
+               double left, double bottom, Pixel **out, int outWidth, int outHeight, Filter filter){
+  const Mat3d &inv = inverse.mat();
+
+  // moving one pixel right adds the first column of the matrix to the homogeneous point, and
+  // moving one row up the second
+  Vec3d d = inv.column(0), e = inv.column(1);
+
+  unique_ptr<Pixel[]> premultiplied;
+  vector<Pixel *> premultipliedRows;
+  if(filter != NEAREST && premultiply(in, inWidth, inHeight, premultiplied, premultipliedRows))
+    in = premultipliedRows.data();
+
+  // filtered affine warps, unless they flatten the source onto a line, are filtered in two 1D passes
+  Kernel kernel(filter);
+  Mat3d map = pixelMap(inverse, left, bottom);
+  WarpClass kind = snapMap(map, outWidth, outHeight);
+  if(filter != NEAREST && kind != PROJECTIVE && map[0][0] * map[1][1] != map[0][1] * map[1][0]){
+    separableWarp(in, inWidth, inHeight, inv, map, left, bottom, kernel, out, outWidth, outHeight);
+    if(premultiplied)
+      unpremultiply(out, outWidth, outHeight);
+    return;
+  }
+
+  vector<MipLevel> mip;
+  if(filter != NEAREST)
+    mip = buildMipmap(in, inWidth, inHeight);
+
+  // nearest sampling of a warp that keeps rows and columns on rows and columns needs no per pixel
+  // mapping at all. output rows map to one source row (or column, when the warp transposes) and
+  // output columns to source columns (or rows) through a table. the tables are evaluated from the
+  // inverse itself, leaving out only the terms the snapped map has dropped
+  bool axial = filter == NEAREST && kind != PROJECTIVE && map[0][1] == 0 && map[1][0] == 0;
+  bool transposing = filter == NEAREST && kind != PROJECTIVE && map[0][0] == 0 && map[1][1] == 0;
+  ColumnMap columns;
+  if(axial)
+    columns = mapColumns(inv[0][0], left, inv[0][2], inv[2][2], outWidth, inWidth);
+  else if(transposing)
+    columns = mapColumns(inv[1][0], left, inv[1][2], inv[2][2], outWidth, inHeight);
+
+  // rotations walk the source across its rows, so the output is split into tiles whose source
+  // footprints are small, and the tiles are shared out among the threads. a tile is made as wide
+  // as it can be while one of its rows still crosses no more than TILE_CROSSING source rows, judged
+  // at the middle of the output, since long runs along a source row stream well by themselves
+  Vec3d mid = inv * Vec2d(left + 0.5 * outWidth, bottom + 0.5 * outHeight);
+  double rowsPerPixel = fabs((d[1] - mid[1] / mid[2] * d[2]) / mid[2]);
+  int tileWidth = outWidth;
+  if(rowsPerPixel * outWidth > TILE_CROSSING)
+    tileWidth = max(WARP_TILE, (int)(TILE_CROSSING / rowsPerPixel));
+
+  int tilesX = (outWidth + tileWidth - 1) / tileWidth;
+  int tilesY = (outHeight + WARP_TILE - 1) / WARP_TILE;
+  parallelTasks(tilesX * tilesY, [&](int tile){
+    int x0 = (tile % tilesX) * tileWidth, x1 = min(x0 + tileWidth, outWidth);
+    int y0 = (tile / tilesX) * WARP_TILE, y1 = min(y0 + WARP_TILE, outHeight);
+    prefetchFootprint(in, inWidth, inHeight, inv, x0 + left, y0 + bottom, x1 - x0, y1 - y0,
+                      filter == NEAREST ? 0 : kernel.radius);
+
+    for(int y = y0; y < y1; y++){
+      if(axial || transposing){
+        int source = axial ? mapIndex((inv[1][1] * (y + bottom) + inv[1][2]) / inv[2][2], inHeight) :
+                             mapIndex((inv[0][1] * (y + bottom) + inv[0][2]) / inv[2][2], inWidth);
+        int x = max(x0, columns.begin), end = min(x1, columns.end);
+        if(source < 0 || x >= end){
+          memset(out[y] + x0, 0, (x1 - x0) * sizeof(Pixel));
+          continue;
+        }
+        memset(out[y] + x0, 0, (x - x0) * sizeof(Pixel));
+        if(axial)
+          axisSpan(in[source], columns, x, end, out[y]);
+        else
+          transposeSpan(in, source, columns, x, end, out[y]);
+        memset(out[y] + end, 0, (x1 - end) * sizeof(Pixel));
+        continue;
+      }
+
+      // homogeneous source point of the first pixel of the scanline
+      Scanline scanline(inv, left, y + bottom);
+      Vec3d h = inv * Vec2d(left, y + bottom);
+
+      // filters sample at pixel centers, where nearest takes the pixel the corner falls in
+      Vec3d center = h + (d + e) * 0.5;
+
+      // only the spans that land in the source are evaluated, the rest is background
+      int spans[2][2];
+      int count = clipSpans(scanline, inWidth, inHeight, x0, x1, spans);
+      int x = x0;
+      for(int i = 0; i < count; i++){
+        memset(out[y] + x, 0, (spans[i][0] - x) * sizeof(Pixel));
+        if(filter == NEAREST)
+          warpSpan(in, inWidth, inHeight, scanline, spans[i][0], spans[i][1], out[y]);
+        else
+          switch(kernel.radius){
+            case 1: filterSpan<2>(mip, kernel, center, d, e, spans[i][0], spans[i][1], out[y]); break;
+            case 2: filterSpan<4>(mip, kernel, center, d, e, spans[i][0], spans[i][1], out[y]); break;
+            default: filterSpan<6>(mip, kernel, center, d, e, spans[i][0], spans[i][1], out[y]); break;
+          }
+        x = spans[i][1];
+      }
+      memset(out[y] + x, 0, (x1 - x) * sizeof(Pixel));
+    }
+  });
+  if(premultiplied)
+    unpremultiply(out, outWidth, outHeight);
+}
+
+void cornerPinImage(Pixel **in, int inWidth, int inHeight, const BilinearCoeffs &pin,
+                    double left, double bottom, Pixel **out, int outWidth, int outHeight, Filter filter){
+  unique_ptr<Pixel[]> premultiplied;
+  vector<Pixel *> premultipliedRows;
+  if(filter != NEAREST && premultiply(in, inWidth, inHeight, premultiplied, premultipliedRows))
+    in = premultipliedRows.data();
+
+  vector<MipLevel> mip;
+  Kernel kernel(filter);
+  if(filter != NEAREST)
+    mip = buildMipmap(in, inWidth, inHeight);
+
+  // nearest maps each pixel's corner and truncates, the filters map its center
+  double offset = filter == NEAREST ? 0 : 0.5;
+  double lowest = filter == NEAREST ? -1 : 0;
+
+  // the quad lies within the hull of its corners, so where a scanline crosses the lines between
+  // them bounds the part of it to map. with the diagonals this holds for quads that fold over too
+  double cornerX[4] = {pin.a0, pin.a0 + pin.a2, pin.a0 + pin.a1 + pin.a2 + pin.a3, pin.a0 + pin.a1};
+  double cornerY[4] = {pin.b0, pin.b0 + pin.b2, pin.b0 + pin.b1 + pin.b2 + pin.b3, pin.b0 + pin.b1};
+
+  parallelRows(outHeight, [&](int rowBegin, int rowEnd){
+    double xs[WARP_BLOCK], ys[WARP_BLOCK], us[WARP_BLOCK], vs[WARP_BLOCK];
+    for(int y = rowBegin; y < rowEnd; y++){
+      double sy = y + bottom + offset;
+      double lo = HUGE_VAL, hi = -HUGE_VAL;
+      for(int j = 0; j < 4; j++){
+        for(int k = j + 1; k < 4; k++){
+          double x0 = cornerX[j], y0 = cornerY[j], x1 = cornerX[k], y1 = cornerY[k];
+          if((sy < y0) == (sy < y1))
+            continue;
+          double cross = x0 + (sy - y0) / (y1 - y0) * (x1 - x0);
+          lo = fmin(lo, cross);
+          hi = fmax(hi, cross);
+        }
+      }
+      // a pixel either side of the crossings, for rounding
+      int xBegin = 0, xEnd = 0;
+      if(lo <= hi){
+        xBegin = (int)fmax(0.0, fmin((double)outWidth, floor(lo - left - offset) - 1));
+        xEnd = (int)fmax(0.0, fmin((double)outWidth, ceil(hi - left - offset) + 2));
+      }
+      memset(out[y], 0, xBegin * sizeof(Pixel));
+      memset(out[y] + xEnd, 0, (outWidth - xEnd) * sizeof(Pixel));
+
+      for(int x = xBegin; x < xEnd; x += WARP_BLOCK){
+        int n = xEnd - x < WARP_BLOCK ? xEnd - x : WARP_BLOCK;
+        for(int i = 0; i < n; i++){
+          xs[i] = x + i + left + offset;
+          ys[i] = sy;
+        }
+        invbilinear(pin, xs, ys, n, us, vs);
+
+        for(int i = 0; i < n; i++){
+          double u = us[i], v = vs[i];
+          Pixel &p = out[y][x + i];
+          // points off the quad have no real root, or roots off the source, so NaN fails this too
+          if(!(u > lowest && u < inWidth && v > lowest && v < inHeight)){
+            memset(&p, 0, sizeof(p));
+          }
+          else if(filter == NEAREST){
+            p = in[(int)v][(int)u];
+          }
+          else{
+            // jacobian of the map from the quad back to the source, inverted from the forward
+            // bilinear map's at the source point
+            double s = u / pin.width, t = v / pin.height;
+            double xu = pin.a1 + pin.a3 * t, xt = pin.a2 + pin.a3 * s;
+            double yu = pin.b1 + pin.b3 * t, yt = pin.b2 + pin.b3 * s;
+            double det = xu * yt - xt * yu;
+            float ux = pin.width * yt / det, uy = -pin.width * xt / det;
+            float vx = -pin.height * yu / det, vy = pin.height * xu / det;
+            float footprint = fmaxf(ux * ux + vx * vx, uy * uy + vy * vy);
+            p = storeColor(filterPoint(mip, kernel, u, v, footprint));
+          }
+        }
+      }
+    }
+  });
+  if(premultiplied)
+    unpremultiply(out, outWidth, outHeight);
+}
@@ -0,0 +1,86 @@
+//Ryan Painter
+//rapaint
+
+/*
+ * Inverse mapping of pixmaps through a Matrix3D, a scanline at a time.
+ */
+
+#ifndef _WARP_INCLUDED_
+#define _WARP_INCLUDED_
+
+#include "matrix.h"
+
+struct Pixel{ // defines a pixel structure
+	unsigned char r,g,b,a;
+};
+
+// how the source is sampled at a mapped point
+enum Filter{
+  NEAREST,      // the pixel the point falls in
+  BILINEAR,     // 2x2 tent
+  CATMULL_ROM,  // 4x4 cubic, sharp
+  MITCHELL,     // 4x4 cubic, smoother with less ringing
+  LANCZOS3      // 6x6 windowed sinc
+};
+
+// what a warp does to the output's pixel grid, from the cheapest to map to the dearest
+enum WarpClass{
+  IDENTITY,             // pixels copy straight across
+  INTEGER_TRANSLATION,  // pixels move by whole pixels
+  AXIS_SCALE,           // rows and columns stay rows and columns, scaled or flipped
+  RIGHT_ANGLE,          // a multiple of 90 degrees of rotation, or a flip, moved by whole pixels
+  AFFINE,               // anything else that keeps parallel lines parallel
+  PROJECTIVE
+};
+
+/*
+ Classifies the warp warpImage makes from output pixels to the source for inverse, left and bottom,
+ over an output of outWidth x outHeight. Coefficients within rounding of 0 or +-1, and offsets within
+ rounding of a whole pixel, count as exact, where rounding is judged across the whole output.
+*/
+WarpClass classifyWarp(const Matrix3D &inverse, double left, double bottom, int outWidth, int outHeight);
+
+/*
+ Fills the outWidth x outHeight pixmap out by inverse mapping each of its pixels through inverse
+ into in. Output pixel (x, y) sits at (x + left, y + bottom) in the warped plane. With NEAREST
+ source coordinates are truncated to the pixel they fall in. The other filters reconstruct the
+ source around the point, widened where the warp shrinks the image so it does not alias. A source
+ with any transparency is filtered premultiplied by alpha. Pixels that land outside in are
+ transparent black.
+
+ With NEAREST each pixel's source point is evaluated with the same arithmetic as a loop doing
+ inverse * (x + left, y + bottom, 1) and dividing by z, a few pixels at a time, so the same pixels
+ are picked even where a point falls exactly on a pixel edge. The filters step the point along a
+ scanline by a constant delta per pixel instead. The part of each scanline that lands in the source
+ is found analytically first, so the background around it is cleared without being mapped. The
+ output is worked in strips of 64 rows, the full width unless a row would cross too many source
+ rows, in which case they are split into narrower tiles. Each thread starts on its own run of tiles
+ and steals from the others' once it is done, and each tile's source footprint is prefetched before
+ it is mapped. With NEAREST, warps that keep rows and columns on rows and columns are copied through
+ a per-column table instead (rows are copied or reversed whole where they can be), and affine warps
+ skip the divide. With the other filters, affine warps are filtered in two 1D passes, the source
+ rows resampled where the output's columns cross them and then filtered down those columns, and each
+ pass stretches its kernel by as much as the warp shrinks the image across it. Projective warps
+ filter each pixel in 2D instead, from the mip levels around its footprint, which costs several
+ times more. Either way the weights of a pixel's taps come from a table of the kernel at 1024 phases
+ per pixel, and taps are filtered in fixed point, two at a time.
+*/
+void warpImage(Pixel **in, int inWidth, int inHeight, const Matrix3D &inverse,
+               double left, double bottom, Pixel **out, int outWidth, int outHeight, Filter filter = NEAREST);
+
+/*
+ Fills the outWidth x outHeight pixmap out from in through a corner pin: the bilinear map that takes
+ in's corners to the four corners pin was set up with (setbilinear, with in's size). Output pixel
+ (x, y) sits at (x + left, y + bottom), and is inverse mapped with the batched invbilinear a block of
+ a scanline at a time, over the part of the scanline within the hull of the quad's corners. Pixels
+ off the quad are transparent black. Filters are as for warpImage.
+
+ Known limitation: with nearest sampling this is 3 to 4 times slower than warpImage on a projective
+ warp of the same size. Every pixel's inverse takes a square root and two divides, where warpImage
+ steps a matrix along the row. Tracking the root from pixel to pixel with a Newton step saved only
+ about a fifth of the inverse with AVX and lost time with SSE2, so it was left out.
+*/
+void cornerPinImage(Pixel **in, int inWidth, int inHeight, const BilinearCoeffs &pin,
+                    double left, double bottom, Pixel **out, int outWidth, int outHeight, Filter filter = NEAREST);
+
+#endif
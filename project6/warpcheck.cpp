@@ -0,0 +1,124 @@
+//Ryan Painter
+//rapaint
+
+/*
+ * Checks warpImage's nearest sampling against the per-pixel loop it replaced, which mapped every
+ * output pixel through the inverse with Matrix3D * Vector3D, divided by z and truncated. Every warp
+ * class is covered, with shears and perspectives whose points land exactly on pixel edges, where
+ * any difference in rounding picks a different pixel. usage: ./warpcheck, exits 1 if a warp differs
+ */
+
+#include "warp.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// source size, odd on both sides so no warp lines up with it by chance
+#define CHECK_WIDTH 333
+#define CHECK_HEIGHT 217
+
+static const char *className[] = {"identity", "integer translation", "axis scale", "right angle",
+                                   "affine", "projective"};
+
+// the loop warpImage replaced
+static void referenceWarp(Pixel **in, int inWidth, int inHeight, const Matrix3D &invM, double left,
+                          double bottom, Pixel **out, int outWidth, int outHeight){
+  for(int y = 0; y < outHeight; y++){
+    for(int x = 0; x < outWidth; x++){
+      Vector3D outPixel(x + left, y + bottom, 1);
+      Vector3D inPixel = invM * outPixel;
+      double u = inPixel.x / inPixel.z;
+      double v = inPixel.y / inPixel.z;
+      if(u > -1 && u < inWidth && v > -1 && v < inHeight)
+        out[y][x] = in[(int)v][(int)u];
+      else
+        memset(&out[y][x], 0, sizeof(Pixel));
+    }
+  }
+}
+
+static vector<Pixel *> rowsOf(vector<Pixel> &pixels, int width, int height){
+  vector<Pixel *> rows(height);
+  for(int y = 0; y < height; y++)
+    rows[y] = &pixels[(size_t)y * width];
+  return rows;
+}
+
+int main(){
+  // every source pixel a different color, so a pixel taken from the wrong place shows
+  vector<Pixel> source((size_t)CHECK_WIDTH * CHECK_HEIGHT);
+  for(int y = 0; y < CHECK_HEIGHT; y++){
+    for(int x = 0; x < CHECK_WIDTH; x++){
+      Pixel p = {(unsigned char)x, (unsigned char)y, (unsigned char)((x >> 8) | (y >> 8) << 4), 255};
+      source[(size_t)y * CHECK_WIDTH + x] = p;
+    }
+  }
+  vector<Pixel *> in = rowsOf(source, CHECK_WIDTH, CHECK_HEIGHT);
+
+  struct Case{
+    const char *name;
+    double m[3][3];
+  };
+  double c = cos(PI / 6), s = sin(PI / 6), q = cos(PI / 2), r = sin(PI / 2);
+  const Case cases[] = {
+    {"identity", {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}}},
+    {"translate 13 -7", {{1, 0, 13}, {0, 1, -7}, {0, 0, 1}}},
+    {"translate 2.5 0.25", {{1, 0, 2.5}, {0, 1, 0.25}, {0, 0, 1}}},
+    {"flip x", {{-1, 0, 0}, {0, 1, 0}, {0, 0, 1}}},
+    {"flip y", {{1, 0, 0}, {0, -1, 0}, {0, 0, 1}}},
+    {"rotate 90", {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}}},
+    {"rotate 180", {{-1, 0, 0}, {0, -1, 0}, {0, 0, 1}}},
+    {"rotate 90 as rotated", {{q, -r, 0}, {r, q, 0}, {0, 0, 1}}},
+    {"scale 0.5", {{0.5, 0, 0}, {0, 0.5, 0}, {0, 0, 1}}},
+    {"scale 3 1/3", {{3, 0, 0}, {0, 1 / 3.0, 0}, {0, 0, 1}}},
+    {"scale 1.7 -1.3", {{1.7, 0, 0}, {0, -1.3, 0}, {0, 0, 1}}},
+    {"shear 0.3 0.2", {{1, 0.3, 0}, {0.2, 1, 0}, {0, 0, 1}}},
+    {"shear 0.5 0.25", {{1, 0.5, 0}, {0.25, 1, 0}, {0, 0, 1}}},
+    {"shear 0.1 0 moved", {{1, 0.1, 3}, {0, 1, -2}, {0, 0, 1}}},
+    {"rotate 30", {{c, -s, 0}, {s, c, 0}, {0, 0, 1}}},
+    {"perspective 1/1000", {{1, 0.25, 0}, {0.125, 1, 0}, {0.001, 0.0005, 1}}},
+    {"perspective 1/500", {{1, 0, 0}, {0, 1, 0}, {0.002, 0, 1}}},
+    {"perspective 0.3 0.2", {{1, 0.3, 0}, {0.2, 1, 0}, {0.0004, -0.0002, 1}}},
+    {"perspective scaled", {{2, 0, 1}, {0, 2, 1}, {0.001, 0.001, 2}}},
+  };
+
+  int failures = 0;
+  for(const Case &k : cases){
+    Matrix3D M(k.m);
+    Matrix3D inv = M.inverse();
+
+    // the bounding box of the warped source corners
+    double xs[4], ys[4];
+    for(int i = 0; i < 4; i++){
+      Vector3D p = M * Vector2D((i & 1) * CHECK_WIDTH, (i >> 1) * CHECK_HEIGHT);
+      xs[i] = p.x / p.z;
+      ys[i] = p.y / p.z;
+    }
+    double left = *min_element(xs, xs + 4), bottom = *min_element(ys, ys + 4);
+    int width = *max_element(xs, xs + 4) - left, height = *max_element(ys, ys + 4) - bottom;
+
+    vector<Pixel> expected((size_t)width * height), warped((size_t)width * height);
+    vector<Pixel *> expectedRows = rowsOf(expected, width, height), warpedRows = rowsOf(warped, width, height);
+    referenceWarp(&in[0], CHECK_WIDTH, CHECK_HEIGHT, inv, left, bottom, &expectedRows[0], width, height);
+    warpImage(&in[0], CHECK_WIDTH, CHECK_HEIGHT, inv, left, bottom, &warpedRows[0], width, height, NEAREST);
+
+    long bad = 0;
+    for(size_t i = 0; i < expected.size(); i++)
+      bad += memcmp(&expected[i], &warped[i], sizeof(Pixel)) != 0;
+    cout << k.name << " (" << className[classifyWarp(inv, left, bottom, width, height)] << "): " << bad
+         << " of " << expected.size() << " pixels differ" << endl;
+    if(bad > 0)
+      failures++;
+  }
+
+  if(failures > 0){
+    cout << failures << " warps differ" << endl;
+    return 1;
+  }
+  cout << "all warps match" << endl;
+  return 0;
+}
@@ -13,11 +13,19 @@
  */
 
 #include "matrix.h"
+#include "warp.h"
+#include "parallel.h"
+#include "remap.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #include <GL/glut.h>
 #include <OpenImageIO/imageio.h>
 
@@ -27,10 +35,6 @@ OIIO_NAMESPACE_USING
 
 static int icolor = 0;
 
-struct Pixel{ // defines a pixel structure
-	unsigned char r,g,b,a;
-}; 
-
 //
 // Global variables and constants
 //
@@ -49,6 +53,10 @@ Pixel **warped = NULL; // warped image
 int pixformat; 			// the pixel format used to correctly  draw the image
 
 string saveAs = "";
+Filter filter = NEAREST;  // how the source is sampled by the warp
+
+bool pinned = false;      // whether the warp is a corner pin rather than the matrix
+Vector2D pinCorners[4];   // where a corner pin puts the image's (0, 0), (0, h), (w, h) and (w, 0) corners
 
 /*
 Multiply M by a rotation matrix of angle theta
@@ -56,176 +64,183 @@ Multiply M by a rotation matrix of angle theta
 
 void rotate(Matrix3D &M, float theta) {
 
-	Matrix3D R;  // this initializes R to identity  
 	double rad = PI * theta / 180.0; // convert degrees to radians
 
-	//populate the rotation matrix
-  R[0][0] = cos(rad);
-  R[0][1] = -sin(rad);
-  R[1][0] = sin(rad);
-  R[1][1] = cos(rad);
-
-	M = R * M; //append the rotation to your transformation matrix
+	M = rotation(rad) * M.mat(); //append the rotation to your transformation matrix
 
 }
 
 void scale(Matrix3D &M, float sx, float sy) {
-  Matrix3D S;
-
-  S[0][0] = sx;
-  S[1][1] = sy;
-
-  M = S * M;
+  M = scaling<double>(sx, sy) * M.mat();
 }
 
 void translate(Matrix3D &M, float dx, float dy) {
-  Matrix3D D;
-
-  D[0][2] = dx;
-  D[1][2] = dy;
-
-  M = D * M;
+  M = translation<double>(dx, dy) * M.mat();
 }
 
 void shear(Matrix3D &M, float hx, float hy) {
-  Matrix3D H;
-
-  H[0][1] = hx;
-  H[1][0] = hy;
-
-  M = H * M;
+  M = shearing<double>(hx, hy) * M.mat();
 }
 
 void flip(Matrix3D &M, float fx, float fy) {
-  Matrix3D F;
-
-  if(fx == 1) {
-    F[0][0] = -1.0;
-  }
-
-  if(fy == 1) {
-    F[1][1] = -1.0;
-  }
-
-  M = F * M;
+  M = scaling(fx == 1 ? -1.0 : 1.0, fy == 1 ? -1.0 : 1.0) * M.mat();
 }
 
 void perspectiveWarp(Matrix3D &M, float px, float py) {
-  Matrix3D P;
+  Mat3d P;
 
   P[2][0] = px;
   P[2][1] = py;
 
-  M = P * M;
+  M = P * M.mat();
 }
 
 /*
-Build a transformation matrix from input text
+Build a transformation matrix from input text. Prompts go to out, so a script can be read
+from a file with them sent nowhere. Reading stops at d or at the end of the input
 */
-void read_input(Matrix3D &M) {
+void read_input(Matrix3D &M, istream &in = cin, ostream &out = cout) {
 	string cmd;
   float x, y;
 	
 	/* prompt for user input */
 	do
 	{
-    cout << "enter a command (r, s, t, h, f, p, d)\n";
+    out << "enter a command (r, s, t, h, f, p, c, i, d)\n";
     x = 0.0;
     y = 0.0;
-		cout << "> ";
-		cin >> cmd;
+		out << "> ";
+		if (!(in >> cmd))
+			break;
 		if (cmd.length() != 1){
-			cout << "invalid command, enter r, s, t, h, f, p, d\n";
+			out << "invalid command, enter r, s, t, h, f, p, c, i, d\n";
 		}
 		else {
 			switch (cmd[0]) {
 				case 'r':		/* Rotation, accept angle in degrees */
 					float theta;
-          cout << "input theta in degrees\n> ";
-					cin >> theta;
-					if (cin) {
-						cout << "calling rotate\n";
+          out << "input theta in degrees\n> ";
+					in >> theta;
+					if (in) {
+						out << "calling rotate\n";
 						rotate(M, theta);
 					}
 					else {
 						cerr << "invalid rotation angle\n";
-						cin.clear();
+						in.clear();
 					}						
 					break;
 				case 's':		/* scale, accept scale factors */
-          cout << "input x factor\n> ";
-          cin >> x;
-          cout << "input y factor\n> ";
-          cin >> y;
-          if(cin) {
-            cout << "calling scale\n";
+          out << "input x factor\n> ";
+          in >> x;
+          out << "input y factor\n> ";
+          in >> y;
+          if(in) {
+            out << "calling scale\n";
             scale(M, x, y);
           }
           else {
             cerr << "invalid scale factor\n";
-            cin.clear();
+            in.clear();
           }
 					break;
 				case 't':		/* Translation, accept translations */
-          cout << "input delta x\n> ";
-          cin >> x;
-          cout << "input delta y\n> ";
-          cin >> y;
-          if(cin) {
-            cout << "calling translate\n";
+          out << "input delta x\n> ";
+          in >> x;
+          out << "input delta y\n> ";
+          in >> y;
+          if(in) {
+            out << "calling translate\n";
             translate(M, x, y);
           }
           else {
             cerr << "invalid delta\n";
-            cin.clear();
+            in.clear();
           }
 					break;
 				case 'h':		/* Shear, accept shear factors */
-          cout << "input x factor\n> ";
-          cin >> x;
-          cout << "input y factor\n> ";
-          cin >> y;
-          if(cin) {
-            cout << "calling shear\n";
+          out << "input x factor\n> ";
+          in >> x;
+          out << "input y factor\n> ";
+          in >> y;
+          if(in) {
+            out << "calling shear\n";
             shear(M, x, y);
           }
           else {
             cerr << "invalid shear factor\n";
-            cin.clear();
+            in.clear();
           }
 					break;
 				case 'f':		/* Flip, accept flip factors */
-          cout << "input flip x\n> ";
-          cin >> x;
-          cout << "input flip y\n> ";
-          cin >> y;
-          if(cin) {
-            cout << "calling flip\n";
+          out << "input flip x\n> ";
+          in >> x;
+          out << "input flip y\n> ";
+          in >> y;
+          if(in) {
+            out << "calling flip\n";
             flip(M, x, y);
           }
           else {
             cerr << "invalid flip factor\n";
-            cin.clear();
+            in.clear();
           }
 					break;
 				case 'p':		/* Perspective, accept perspective factors */
-          cout << "input x factor\n> ";
-          cin >> x;
-          cout << "input y factor\n> ";
-          cin >> y;
-          if(cin) {
-            cout << "calling perspective warp\n";
+          out << "input x factor\n> ";
+          in >> x;
+          out << "input y factor\n> ";
+          in >> y;
+          if(in) {
+            out << "calling perspective warp\n";
             perspectiveWarp(M, x, y);
           }
           else {
             cerr << "invalid perspective warp factor\n";
-            cin.clear();
+            in.clear();
           }
 					break;		
+				case 'c':		/* Corner pin, accept where the four corners go */
+          {
+            const char *names[4] = {"(0, 0)", "(0, h)", "(w, h)", "(w, 0)"};
+            Vector2D corners[4];
+            for(int i = 0; i < 4 && in; i++) {
+              out << "input x and y of corner " << names[i] << "\n> ";
+              in >> corners[i].x >> corners[i].y;
+            }
+            if(in) {
+              out << "calling corner pin, which replaces the matrix\n";
+              for(int i = 0; i < 4; i++)
+                pinCorners[i] = corners[i];
+              pinned = true;
+            }
+            else {
+              cerr << "invalid corner\n";
+              in.clear();
+            }
+          }
+					break;
+				case 'i':		/* Interpolation, accept a filter name */
+          out << "input filter (nearest, bilinear, catmull, mitchell, lanczos)\n> ";
+          in >> cmd;
+          if(cmd == "nearest")
+            filter = NEAREST;
+          else if(cmd == "bilinear")
+            filter = BILINEAR;
+          else if(cmd == "catmull")
+            filter = CATMULL_ROM;
+          else if(cmd == "mitchell")
+            filter = MITCHELL;
+          else if(cmd == "lanczos")
+            filter = LANCZOS3;
+          else
+            cerr << "invalid filter\n";
+          cmd = "i";
+					break;
 				case 'd':		/* Done, that's all for now */
 					break;
 				default:
-					cout << "invalid command, enter r, s, t, h, f, p, d\n";
+					out << "invalid command, enter r, s, t, h, f, p, c, i, d\n";
 			}
 		}
 	} while (cmd.compare("d")!=0);
@@ -244,72 +259,96 @@ void destroy(){
 
 
 //
-//  Routine to read an image file and store in a pixmap
-//  returns the size of the image in pixels if correctly read, or 0 if failure
+//  Routines to allocate and free a pixmap (contiguous approach, 2d style access)
 //
-int readImage(string infilename){
+Pixel **allocPixmap(int width, int height){
+  Pixel **pixels = new Pixel*[height];
+  pixels[0] = new Pixel[width * height];
+  for(int i = 1; i < height; i++)
+    pixels[i] = pixels[i - 1] + width;
+  return pixels;
+}
+
+void freePixmap(Pixel **pixels){
+  delete[] pixels[0];
+  delete[] pixels;
+}
+
+//
+//  Routine to read an image file into a new RGBA pixmap, bottom scanline first.
+//  returns NULL on failure. touches no globals, so files can be read on several threads
+//
+Pixel **readPixmap(string infilename, int &width, int &height){
   // Create the oiio file handler for the image, and open the file for reading the image.
   // Once open, the file spec will indicate the width, height and number of channels.
   std::unique_ptr<ImageInput> infile = ImageInput::open(infilename);
   if(!infile){
     cerr << "Could not input image file " << infilename << ", error = " << geterror() << endl;
-    return 0;
+    return NULL;
   }
 
-  // Record image width, height and number of channels in global variables
-  ImWidth = infile->spec().width;
-  ImHeight = infile->spec().height;
-  ImChannels = infile->spec().nchannels;
+  width = infile->spec().width;
+  height = infile->spec().height;
+  int channels = infile->spec().nchannels;
 
- 
   // allocate temporary structure to read the image 
-  unsigned char tmp_pixels[ImWidth * ImHeight * ImChannels];
+  vector<unsigned char> tmp_pixels(width * height * channels);
 
   // read the image into the tmp_pixels from the input file, flipping it upside down using negative y-stride,
   // since OpenGL pixmaps have the bottom scanline first, and 
   // oiio expects the top scanline first in the image file.
-  int scanlinesize = ImWidth * ImChannels * sizeof(unsigned char);
-  if(!infile->read_image(TypeDesc::UINT8, &tmp_pixels[0] + (ImHeight - 1) * scanlinesize, AutoStride, -scanlinesize)){
+  int scanlinesize = width * channels * sizeof(unsigned char);
+  if(!infile->read_image(TypeDesc::UINT8, &tmp_pixels[0] + (height - 1) * scanlinesize, AutoStride, -scanlinesize)){
     cerr << "Could not read image from " << infilename << ", error = " << geterror() << endl;
-    return 0;
+    return NULL;
   }
- 
- // get rid of the old pixmap and make a new one of the new size
-  destroy();
-  
- // allocate space for the Pixmap (contiguous approach, 2d style access)
-  pixmap = new Pixel*[ImHeight];
-  if(pixmap != NULL)
-	pixmap[0] = new Pixel[ImWidth * ImHeight];
-  for(int i = 1; i < ImHeight; i++)
-	pixmap[i] = pixmap[i - 1] + ImWidth;
+
+  Pixel **pixels = allocPixmap(width, height);
  
  //  assign the read pixels to the the data structure
  int index;
-  for(int row = 0; row < ImHeight; ++row) {
-    for(int col = 0; col < ImWidth; ++col) {
-      index = (row*ImWidth+col)*ImChannels;
+  for(int row = 0; row < height; ++row) {
+    for(int col = 0; col < width; ++col) {
+      index = (row*width+col)*channels;
       
-      if (ImChannels==1){ 
-        pixmap[row][col].r = tmp_pixels[index];
-        pixmap[row][col].g = tmp_pixels[index];
-        pixmap[row][col].b = tmp_pixels[index];
-        pixmap[row][col].a = 255;
+      if (channels==1){ 
+        pixels[row][col].r = tmp_pixels[index];
+        pixels[row][col].g = tmp_pixels[index];
+        pixels[row][col].b = tmp_pixels[index];
+        pixels[row][col].a = 255;
       }
       else{
-        pixmap[row][col].r = tmp_pixels[index];
-        pixmap[row][col].g = tmp_pixels[index+1];
-        pixmap[row][col].b = tmp_pixels[index+2];			
-        if (ImChannels <4) // no alpha value is present so set it to 255
-          pixmap[row][col].a = 255; 
+        pixels[row][col].r = tmp_pixels[index];
+        pixels[row][col].g = tmp_pixels[index+1];
+        pixels[row][col].b = tmp_pixels[index+2];			
+        if (channels <4) // no alpha value is present so set it to 255
+          pixels[row][col].a = 255; 
         else // read the alpha value
-          pixmap[row][col].a = tmp_pixels[index+3];			
+          pixels[row][col].a = tmp_pixels[index+3];			
       }
     }
   }
  
   // close the image file after reading, and free up space for the oiio file handler
   infile->close();
+  return pixels;
+}
+
+//
+//  Routine to read an image file and store in a pixmap
+//  returns the size of the image in pixels if correctly read, or 0 if failure
+//
+int readImage(string infilename){
+  int width, height;
+  Pixel **pixels = readPixmap(infilename, width, height);
+  if(!pixels)
+    return 0;
+
+ // get rid of the old pixmap and use the new one
+  destroy();
+  pixmap = pixels;
+  ImWidth = width;
+  ImHeight = height;
   
   // set the pixel format to GL_RGBA and fix the # channels to 4  
   pixformat = GL_RGBA;  
@@ -319,6 +358,34 @@ int readImage(string infilename){
   return ImWidth * ImHeight;
 }
 
+//
+//  Routine to write an RGBA pixmap, bottom scanline first, to an image file
+//  returns false on failure. like readPixmap, it is safe to call on several threads
+//
+bool writePixmap(string outfilename, Pixel **pixels, int width, int height){
+  std::unique_ptr<ImageOutput> outfile = ImageOutput::create(outfilename);
+  if(!outfile){
+    cerr << "Could not create output image for " << outfilename << ", error = " << geterror() << endl;
+    return false;
+  }
+  
+  ImageSpec spec(width, height, 4, TypeDesc::UINT8);
+  if(!outfile->open(outfilename, spec)){
+    cerr << "Could not open " << outfilename << ", error = " << geterror() << endl;
+    return false;
+  }
+  
+  // flip the image upside down by using negative y stride, as writeImage does
+  int scanlinesize = width * sizeof(Pixel);
+  if(!outfile->write_image(TypeDesc::UINT8, (unsigned char *)pixels[0] + (height - 1) * scanlinesize, AutoStride, -scanlinesize)){
+    cerr << "Could not write image to " << outfilename << ", error = " << geterror() << endl;
+    return false;
+  }
+  
+  outfile->close();
+  return true;
+}
+
 //
 // Routine to display a pixmap in the current window
 //
@@ -466,6 +533,181 @@ void handleReshape(int w, int h){
 
 
 
+/*
+   Finds the bounding box of a width x height image warped by M: its lower left corner (left, bottom)
+   and its size
+*/
+void warpBounds(const Matrix3D &M, int width, int height, double &left, double &bottom, int &newWidth, int &newHeight){
+  //a corner pin takes the corners exactly where it was told to
+  if(pinned){
+    double xs[4], ys[4];
+    for(int i = 0; i < 4; i++){
+      xs[i] = pinCorners[i].x;
+      ys[i] = pinCorners[i].y;
+    }
+    left = *min_element(xs, xs + 4);
+    newWidth = *max_element(xs, xs + 4) - left;
+    bottom = *min_element(ys, ys + 4);
+    newHeight = *max_element(ys, ys + 4) - bottom;
+    return;
+  }
+
+
+  //find new corners
+  Vector3D topLeft(0.0, 0.0, 0.0);
+  Vector3D topRight(width, 0.0, 0.0);
+  Vector3D bottomLeft(0.0, height, 0.0);
+  Vector3D bottomRight(width, height, 0.0);
+
+  Vector3D warpTopLeft = M * topLeft;
+  Vector3D warpTopRight = M * topRight;
+  Vector3D warpBottomLeft = M * bottomLeft;
+  Vector3D warpBottomRight = M * bottomRight;
+
+  //find new size
+  double xs[4] = {warpTopLeft.x, warpTopRight.x, warpBottomLeft.x, warpBottomRight.x};
+  double right = *max_element(xs, xs + 4);
+  left = *min_element(xs, xs + 4);
+  newWidth = abs(right - left);
+  double ys[4] = {warpTopLeft.y, warpTopRight.y, warpBottomLeft.y, warpBottomRight.y};
+  double top = *max_element(ys, ys + 4);
+  bottom = *min_element(ys, ys + 4);
+  newHeight = abs(top - bottom);
+}
+
+/*
+   Warps in into out by the corner pin if there is one, otherwise through invM, with output pixel
+   (x, y) at (x + left, y + bottom)
+*/
+void warpPixmap(Pixel **in, int width, int height, const Matrix3D &invM, double left, double bottom,
+                Pixel **out, int newWidth, int newHeight){
+  if(pinned){
+    BilinearCoeffs pin;
+    setbilinear(width, height, pinCorners, pin);
+    cornerPinImage(in, width, height, pin, left, bottom, out, newWidth, newHeight, filter);
+  }
+  else
+    warpImage(in, width, height, invM, left, bottom, out, newWidth, newHeight, filter);
+}
+
+/*
+   Headless batch mode: reads the transform commands from a script file once, builds and inverts
+   the matrix once, then warps every input file into outdir under the same name. Each file is read,
+   warped and written by one task of a thread pool, so while one thread warps, others are decoding
+   and encoding. The warp runs serially inside its task, as the files already keep the threads busy.
+   Given a remap table file, the warp's map is evaluated once into it, on a grid of the given spacing
+   if that is more than 1, or mapped from the file if an earlier run made it for the same warp and
+   filter. Files the size of the table's source are then warped by a gather through it, which only
+   samples the nearest pixel or bilinearly, so the other filters are refused
+*/
+int runBatch(string scriptname, string outdir, const vector<string> &files, string remapname, int grid){
+  ifstream script(scriptname);
+  if(!script){
+    cerr << "Could not open script " << scriptname << endl;
+    return -1;
+  }
+
+  Matrix3D M;
+  ostream quiet(NULL);
+  read_input(M, script, quiet);
+  M.print();
+  Matrix3D invM = M.inverse();
+  const Mat3d &inv = invM.mat();
+
+  if(remapname != "" && filter != NEAREST && filter != BILINEAR){
+    cerr << "Remap tables only sample nearest or bilinear, choose one of them with i" << endl;
+    return -1;
+  }
+
+  // the table is keyed on the inverse matrix, or the pin's corners, and the filter
+  RemapKey key;
+  key.nearest = filter == NEAREST;
+  if(pinned){
+    key.kind = 1;
+    for(int i = 0; i < 4; i++){
+      key.map[2 * i] = pinCorners[i].x;
+      key.map[2 * i + 1] = pinCorners[i].y;
+    }
+  }
+  else
+    for(int i = 0; i < 9; i++)
+      key.map[i] = inv[i / 3][i % 3];
+
+  RemapTable table;
+  if(remapname != "" && !loadRemap(table, remapname, key)){
+    std::unique_ptr<ImageInput> first = ImageInput::open(files[0]);
+    double left, bottom;
+    int newWidth = 0, newHeight = 0;
+    if(first)
+      warpBounds(M, first->spec().width, first->spec().height, left, bottom, newWidth, newHeight);
+    if(newWidth > 0 && newHeight > 0){
+      BilinearCoeffs pin;
+      setbilinear(first->spec().width, first->spec().height, pinCorners, pin);
+      bool built = buildRemap(table, newWidth, newHeight, first->spec().width, first->spec().height, grid, key,
+                 [&](double x, double y, double &u, double &v){
+                   if(pinned){
+                     Vector2D uv;
+                     invbilinear(pin, Vector2D(x + left, y + bottom), uv);
+                     u = uv.x;
+                     v = uv.y;
+                     return;
+                   }
+                   Vec3d p = inv * Vec2d(x + left, y + bottom);
+                   u = p[0] / p[2];
+                   v = p[1] / p[2];
+                 });
+      if(!built)
+        cerr << "Images are too large for a remap table, at most " << REMAP_MAX_SIZE << " pixels a side" << endl;
+      else if(!saveRemap(table, remapname))
+        cerr << "Could not write remap table " << remapname << endl;
+    }
+  }
+
+  atomic<int> failed(0);
+  auto start = chrono::steady_clock::now();
+  parallelTasks((int)files.size(), [&](int i){
+    int width, height;
+    Pixel **in = readPixmap(files[i], width, height);
+    if(!in){
+      failed++;
+      return;
+    }
+
+    double left, bottom;
+    int newWidth, newHeight;
+    bool remap = table.width > 0 && width == table.inWidth && height == table.inHeight;
+    if(remap){
+      newWidth = table.width;
+      newHeight = table.height;
+    }
+    else
+      warpBounds(M, width, height, left, bottom, newWidth, newHeight);
+    if(newWidth <= 0 || newHeight <= 0){
+      cerr << "warp of " << files[i] << " is empty" << endl;
+      freePixmap(in);
+      failed++;
+      return;
+    }
+
+    Pixel **out = allocPixmap(newWidth, newHeight);
+    if(remap)
+      applyRemap(table, in, out);
+    else
+      warpPixmap(in, width, height, invM, left, bottom, out, newWidth, newHeight);
+    string name = files[i].substr(files[i].find_last_of('/') + 1);
+    if(!writePixmap(outdir + "/" + name, out, newWidth, newHeight))
+      failed++;
+    freePixmap(in);
+    freePixmap(out);
+  });
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  int written = files.size() - failed;
+  cout << "warped " << written << " of " << files.size() << " images in " << seconds << " s, "
+       << written / seconds << " images/sec" << endl;
+  return failed ? -1 : 0;
+}
+
 /*
    Main program to read an image file, then ask the user
    for transform information, transform the image and display
@@ -473,8 +715,27 @@ void handleReshape(int w, int h){
    images in  files.
 */
 int main(int argc, char *argv[]){
+  if(argc >= 2 && string(argv[1]) == "-batch") {
+    // options between outdir and the inputs
+    string remapname = "";
+    int grid = 1;
+    int first = 4;
+    while(first + 1 < argc && (string(argv[first]) == "-remap" || string(argv[first]) == "-grid")) {
+      if(string(argv[first]) == "-remap")
+        remapname = argv[first + 1];
+      else
+        grid = atoi(argv[first + 1]);
+      first += 2;
+    }
+    if(first >= argc) {
+      cerr << "incorrect usage. correct usage is: \"./warper -batch script outdir [-remap table [-grid n]] in.ext...\"" << endl;
+      exit(-1);
+    }
+    return runBatch(argv[2], argv[3], vector<string>(argv + first, argv + argc), remapname, grid);
+  }
+
 	if(argc != 2 && argc != 3) {
-		cerr << "incorrect usage. correct usage is: \"./warper in.ext [out.ext]\"" << endl;
+		cerr << "incorrect usage. correct usage is: \"./warper in.ext [out.ext]\" or \"./warper -batch script outdir in.ext...\"" << endl;
 		exit(-1);
   }
 
@@ -496,55 +757,18 @@ int main(int argc, char *argv[]){
 
 	// your code to perform inverse mapping (4 steps)
 
-  //find new corners
-  Vector3D topLeft(0.0, 0.0, 0.0);
-  Vector3D topRight(ImWidth, 0.0, 0.0);
-  Vector3D bottomLeft(0.0, ImHeight, 0.0);
-  Vector3D bottomRight(ImWidth, ImHeight, 0.0);
-
-  Vector3D warpTopLeft = M * topLeft;
-  Vector3D warpTopRight = M * topRight;
-  Vector3D warpBottomLeft = M * bottomLeft;
-  Vector3D warpBottomRight = M * bottomRight;
-
-  //find new size
-  double xs[4] = {warpTopLeft.x, warpTopRight.x, warpBottomLeft.x, warpBottomRight.x};
-  double right = *max_element(xs, xs + 4);
-  double left = *min_element(xs, xs + 4);
-  int newWidth = abs(right - left);
-  double ys[4] = {warpTopLeft.y, warpTopRight.y, warpBottomLeft.y, warpBottomRight.y};
-  double top = *max_element(ys, ys + 4);
-  double bottom = *min_element(ys, ys + 4);
-  int newHeight = abs(top - bottom);
+  //find the bounds of the warped image
+  double left, bottom;
+  int newWidth, newHeight;
+  warpBounds(M, ImWidth, ImHeight, left, bottom, newWidth, newHeight);
 
   //allocate space for pixmap of new size
-  warped = new Pixel*[newHeight];
-  if(warped != NULL)
-	warped[0] = new Pixel[newWidth * newHeight];
-  for(int i = 1; i < newHeight; i++)
-	warped[i] = warped[i - 1] + newWidth;
+  warped = allocPixmap(newWidth, newHeight);
 
   Matrix3D invM = M.inverse();
-  int u, v;
-
-  //warp
-  for(int y = 0; y < newHeight; y++) {
-    for(int x = 0; x < newWidth; x++) {
-      //map pixel coords
-      //current coords + origin
-      Vector3D outPixel(x + left, y + bottom, 1);
-      Vector3D inPixel = invM * outPixel;
-
-      //normalize
-      u = inPixel.x / inPixel.z;
-      v = inPixel.y / inPixel.z;
-
-      //only copy the pixel if it exists in pixmap.
-      if(u >= 0 && u < ImWidth && v >= 0 && v < ImHeight) {
-        warped[y][x] = pixmap[v][u];
-      }
-    }
-  }
+
+  //warp, with output pixel (x, y) at (x + left, y + bottom)
+  warpPixmap(pixmap, ImWidth, ImHeight, invM, left, bottom, warped, newWidth, newHeight);
 
   pixmap = warped;
   ImHeight = newHeight;
@@ -10,6 +10,9 @@
 #include <GL/glut.h>
 #include <OpenImageIO/imageio.h>
 
+#include "mat.h"
+#include "remap.h"
+
 using namespace std;
 using std::string;
 OIIO_NAMESPACE_USING
@@ -37,6 +40,15 @@ Pixel **pixmap = NULL;  // the image pixmap used for OpenGL display
 Pixel **warpedPixmap = NULL;
 int pixformat; 			// the pixel format used to correctly  draw the image
 
+// inv_map halves the normalized coordinates. being constant, it folds into the map at compile time
+constexpr Mat3f HALVE = scaling(0.5f, 0.5f);
+
+// inv_map as a matrix, so loops over many pixels can build it once: normalize (x, y), halve, and
+// scale back to the input's pixel coords
+inline Mat3f inv_map_matrix(int inwidth, int inheight, int outwidth, int outheight){
+  return scaling((float)inwidth / outwidth, (float)inheight / outheight) * HALVE;
+}
+
 /*
   Routine to inverse map (x, y) output image spatial coordinates
   into (u, v) input image spatial coordinates
@@ -51,15 +63,9 @@ int pixformat; 			// the pixel format used to correctly  draw the image
 */
 void inv_map(float x, float y, float &u, float &v,
 	int inwidth, int inheight, int outwidth, int outheight){
-  
-  x /= outwidth;		// normalize (x, y) to (0...1, 0...1)
-  y /= outheight;
-
-  u = x/2;
-  v = y/2; 
-  
-  u *= inwidth;			// scale normalized (u, v) to pixel coords
-  v *= inheight;
+  Vec3f uv = inv_map_matrix(inwidth, inheight, outwidth, outheight) * Vec2f(x, y);
+  u = uv[0];
+  v = uv[1];
 }
 
 void inv_map2(float x, float y, float &u, float &v,
@@ -80,9 +86,12 @@ void repair() {
   float u, v, a, b;
   int j, k;
   Pixel tempPixel, topLeft, topRight, bottomLeft, bottomRight;
+  Mat3f map = inv_map_matrix(ImHeight, ImWidth, ImHeight, ImWidth);
   for(int r = 0; r < ImHeight; r++) {
     for(int c = 0; c < ImWidth; c++) {
-      inv_map(r, c, u, v, ImHeight, ImWidth, ImHeight, ImWidth);
+      Vec3f uv = map * Vec2f(r, c);
+      u = uv[0];
+      v = uv[1];
 
       j = (int)(u);
       k = (int)(v);
@@ -371,21 +380,51 @@ void handleReshape(int w, int h){
    images in  files.
 */
 int main(int argc, char *argv[]){
-	if(argc != 2) {
-		cerr << "incorrect usage. correct usage is: \"./okwarp in.ext\"" << endl;
+	if(argc != 2 && argc != 3) {
+		cerr << "incorrect usage. correct usage is: \"./okwarp in.ext [table]\"" << endl;
 		exit(-1);
   }
 
 	//your code to read in the input image
 	readImage(argv[1]);
 
-  //inverse map
-  float u, v;
-  for(int r = 0; r < ImHeight; r++) {
-    for(int c = 0; c < ImWidth; c++) {
-      inv_map(r, c, u, v, ImHeight, ImWidth, ImHeight, ImWidth);
-
-      warpedPixmap[r][c] = pixmap[(int)(u)][(int)(v)];
+  if(argc == 3) {
+    //inverse map through a remap table, mapped from the file if an earlier run of an image this
+    //size made it, otherwise evaluated from inv_map (which takes the row first) and saved. the table
+    //copies the nearest pixel, as the loop below does, and is keyed on inv_map's matrix, so a table
+    //made by a build with a different inv_map is made again
+    RemapTable table;
+    RemapKey key;
+    key.nearest = 1;
+    Mat3f keyMap = inv_map_matrix(ImHeight, ImWidth, ImHeight, ImWidth);
+    for(int i = 0; i < 9; i++)
+      key.map[i] = keyMap[i / 3][i % 3];
+    if(!loadRemap(table, argv[2], key) || table.inWidth != ImWidth || table.inHeight != ImHeight ||
+       table.width != ImWidth || table.height != ImHeight) {
+      if(!buildRemap(table, ImWidth, ImHeight, ImWidth, ImHeight, 1, key,
+                 [](double x, double y, double &u, double &v) {
+                   float row, col;
+                   inv_map(y, x, row, col, ImHeight, ImWidth, ImHeight, ImWidth);
+                   u = col;
+                   v = row;
+                 })) {
+        cerr << "Image is too large for a remap table, at most " << REMAP_MAX_SIZE << " pixels a side" << endl;
+        exit(-1);
+      }
+      if(!saveRemap(table, argv[2]))
+        cerr << "Could not write remap table " << argv[2] << endl;
+    }
+    applyRemap(table, pixmap, warpedPixmap);
+  }
+  else {
+    //inverse map
+    Mat3f map = inv_map_matrix(ImHeight, ImWidth, ImHeight, ImWidth);
+    for(int r = 0; r < ImHeight; r++) {
+      for(int c = 0; c < ImWidth; c++) {
+        Vec3f uv = map * Vec2f(r, c);
+
+        warpedPixmap[r][c] = pixmap[(int)(uv[0])][(int)(uv[1])];
+      }
     }
   }
 